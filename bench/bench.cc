@@ -0,0 +1,49 @@
+#include "bench.hh"
+
+#include <system/syscall.hh>
+#include <ustd/algorithm.hh>
+#include <ustd/numeric.hh>
+#include <ustd/string.hh>
+#include <ustd/string_builder.hh>
+#include <ustd/string_view.hh>
+#include <ustd/types.hh>
+#include <ustd/vector.hh>
+
+namespace bench {
+namespace {
+
+// Results go out as debug lines, which reach the QEMU debug port when the kernel is built with kernel_qemu_debug.
+// Each result is a single line of space-separated key=value pairs so that tools/run_bench.bash can pick them out.
+void emit(const ustd::String &line) {
+    static_cast<void>(system::syscall(UB_SYS_debug_line, line.data()));
+}
+
+} // namespace
+
+void finish() {
+    emit(ustd::format("bench done"));
+}
+
+void report(ustd::StringView name, size_t batch_size, ustd::Vector<size_t> &&batch_times) {
+    ustd::sort(batch_times);
+    size_t total = 0;
+    for (auto time : batch_times) {
+        total += time;
+    }
+
+    // All times are per operation.
+    const auto min = batch_times.first() / batch_size;
+    const auto median = batch_times[batch_times.size() / 2] / batch_size;
+    const auto max = batch_times.last() / batch_size;
+    const auto mean = total / (batch_times.size() * batch_size);
+    emit(ustd::format("bench name={} ops={} min_ns={} median_ns={} mean_ns={} max_ns={}", name,
+                      batch_times.size() * batch_size, min, median, mean, max));
+}
+
+// For benchmarks which time a fixed amount of work spread over several processes as a whole, rather than per operation.
+void report_rate(ustd::StringView name, size_t ops, size_t time) {
+    emit(ustd::format("bench name={} ops={} time_ns={} ops_per_sec={}", name, ops, time,
+                      ops * 1000000000 / ustd::max(time, 1ul)));
+}
+
+} // namespace bench
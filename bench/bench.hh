@@ -0,0 +1,37 @@
+#pragma once
+
+#include <core/time.hh>
+#include <ustd/string_view.hh>
+#include <ustd/types.hh>
+#include <ustd/utility.hh>
+#include <ustd/vector.hh>
+
+namespace bench {
+
+constexpr size_t k_batch_count = 32;
+
+void finish();
+void report(ustd::StringView name, size_t batch_size, ustd::Vector<size_t> &&batch_times);
+void report_rate(ustd::StringView name, size_t ops, size_t time);
+
+// Runs function in k_batch_count timed batches of batch_size operations, after an untimed warm-up batch. Timing whole
+// batches keeps the cost of reading the clock out of the results for very short operations.
+template <typename F>
+void run(ustd::StringView name, size_t batch_size, F function) {
+    for (size_t i = 0; i < batch_size; i++) {
+        function();
+    }
+
+    ustd::Vector<size_t> batch_times;
+    batch_times.ensure_capacity(k_batch_count);
+    for (size_t batch = 0; batch < k_batch_count; batch++) {
+        const auto start = core::time();
+        for (size_t i = 0; i < batch_size; i++) {
+            function();
+        }
+        batch_times.push(core::time() - start);
+    }
+    report(name, batch_size, ustd::move(batch_times));
+}
+
+} // namespace bench
@@ -0,0 +1,341 @@
+#include "bench.hh"
+
+#include <core/event_loop.hh>
+#include <core/file_system.hh>
+#include <core/pipe.hh>
+#include <core/process.hh>
+#include <core/time.hh>
+#include <ipc/client.hh>
+#include <ipc/message.hh>
+#include <ipc/message_decoder.hh>
+#include <ipc/message_encoder.hh>
+#include <ipc/server.hh>
+#include <system/syscall.hh>
+#include <system/system.h>
+#include <ustd/array.hh>
+#include <ustd/assert.hh>
+#include <ustd/result.hh>
+#include <ustd/span.hh>
+#include <ustd/string.hh>
+#include <ustd/string_builder.hh>
+#include <ustd/string_view.hh>
+#include <ustd/types.hh>
+#include <ustd/utility.hh>
+#include <ustd/vector.hh>
+
+namespace {
+
+constexpr const char *k_bench_path = "/bin/bench";
+constexpr const char *k_socket_path = "/run/bench";
+constexpr ustd::StringView k_ipc_path = "/run/bench-ipc"sv;
+
+// The file descriptors given to pipe children, and the byte which tells an echo child to exit.
+constexpr uint32_t k_echo_in_fd = 3;
+constexpr uint32_t k_echo_out_fd = 4;
+constexpr uint8_t k_echo_exit = 0xff;
+
+// The number of doorbells each heap stress child creates and destroys.
+constexpr size_t k_heap_stress_doorbells = 10000;
+
+enum class EchoKind : uint8_t {
+    Echo,
+    Exit,
+};
+
+// An empty message, which the IPC echo server answers with another, unless it is told to exit.
+class EchoMessage final : public ipc::Message {
+    EchoKind m_kind;
+
+public:
+    explicit EchoMessage(EchoKind kind = EchoKind::Echo) : m_kind(kind) {}
+
+    static EchoMessage decode(ustd::Span<const uint8_t> buffer) {
+        ipc::MessageDecoder decoder(buffer);
+        return EchoMessage(decoder.decode<EchoKind>());
+    }
+
+    void encode(ipc::MessageEncoder &encoder) const override { encoder.encode(m_kind); }
+};
+
+size_t spawn(const char *mode, ustd::Vector<ub_fd_pair_t> copy_fds = {}) {
+    ustd::Vector<const char *> argv;
+    argv.push(k_bench_path);
+    argv.push(mode);
+    return EXPECT(core::create_process(k_bench_path, ustd::move(argv), ustd::move(copy_fds)));
+}
+
+size_t echo(uint32_t in_fd, uint32_t out_fd, bool poll) {
+    while (true) {
+        if (poll) {
+            ub_poll_fd_t poll_fd{.fd = in_fd, .events = UB_POLL_EVENT_READ, .revents = {}};
+            EXPECT(system::syscall(UB_SYS_poll, &poll_fd, 1, -1));
+        }
+        uint8_t byte = 0;
+        if (EXPECT(system::syscall(UB_SYS_read, in_fd, &byte, 1)) == 0 || byte == k_echo_exit) {
+            return 0;
+        }
+        EXPECT(system::syscall(UB_SYS_write, out_fd, &byte, 1));
+    }
+}
+
+size_t sink(uint32_t in_fd) {
+    // NOLINTNEXTLINE
+    ustd::Array<uint8_t, 64_KiB> buffer;
+    while (EXPECT(system::syscall(UB_SYS_read, in_fd, buffer.data(), buffer.size())) != 0) {
+    }
+    return 0;
+}
+
+// Waits for the start byte and then creates and destroys doorbells, each of which is a single small kernel object of
+// the sizes served by the per-CPU heap magazines. Each child is a process of its own so that the children don't
+// serialise on a shared process lock.
+size_t heap_stress(uint32_t start_fd) {
+    uint8_t byte = 0;
+    EXPECT(system::syscall(UB_SYS_read, start_fd, &byte, 1));
+    ustd::Array<uint32_t, 2> doorbell_fds{};
+    for (size_t i = 0; i < k_heap_stress_doorbells; i++) {
+        EXPECT(system::syscall(UB_SYS_create_doorbell, doorbell_fds.data()));
+        EXPECT(system::syscall(UB_SYS_close, doorbell_fds[0]));
+        EXPECT(system::syscall(UB_SYS_close, doorbell_fds[1]));
+    }
+    return 0;
+}
+
+void ping(uint32_t out_fd, uint32_t in_fd) {
+    uint8_t byte = 0;
+    EXPECT(system::syscall(UB_SYS_write, out_fd, &byte, 1));
+    EXPECT(system::syscall(UB_SYS_read, in_fd, &byte, 1));
+}
+
+void stop_echo(uint32_t fd, size_t pid) {
+    EXPECT(system::syscall(UB_SYS_write, fd, &k_echo_exit, 1));
+    EXPECT(core::wait_pid(pid));
+}
+
+// With poll set, the child waits in poll before each read, so the difference to the plain pipe ping-pong is the cost
+// of a poll wakeup.
+void bench_pipe_ping_pong(bool poll) {
+    auto request = EXPECT(core::create_pipe());
+    auto reply = EXPECT(core::create_pipe());
+    ustd::Vector<ub_fd_pair_t> copy_fds;
+    copy_fds.push({request.read_fd(), k_echo_in_fd});
+    copy_fds.push({reply.write_fd(), k_echo_out_fd});
+    const auto pid = spawn(poll ? "poll-echo" : "pipe-echo", ustd::move(copy_fds));
+    request.close_read();
+    reply.close_write();
+
+    bench::run(poll ? "poll_wakeup" : "pipe_ping_pong", 1000, [&] {
+        ping(request.write_fd(), reply.read_fd());
+    });
+    stop_echo(request.write_fd(), pid);
+}
+
+void bench_pipe_throughput() {
+    auto pipe = EXPECT(core::create_pipe());
+    ustd::Vector<ub_fd_pair_t> copy_fds;
+    copy_fds.push({pipe.read_fd(), k_echo_in_fd});
+    const auto pid = spawn("pipe-sink", ustd::move(copy_fds));
+    pipe.close_read();
+
+    // NOLINTNEXTLINE
+    ustd::Array<uint8_t, 4_KiB> chunk;
+    bench::run("pipe_write_4k", 1000, [&] {
+        for (size_t written = 0; written < chunk.size();) {
+            written += EXPECT(system::syscall(UB_SYS_write, pipe.write_fd(), chunk.data() + written,
+                                              chunk.size() - written));
+        }
+    });
+
+    // Closing the write end gives the sink end of file.
+    pipe.close_write();
+    EXPECT(core::wait_pid(pid));
+}
+
+void bench_socket_ping_pong() {
+    const auto server_fd = EXPECT(system::syscall<uint32_t>(UB_SYS_create_server_socket, 1));
+    EXPECT(system::syscall(UB_SYS_bind, server_fd, k_socket_path));
+    const auto pid = spawn("socket-echo");
+    const auto fd = EXPECT(system::syscall<uint32_t>(UB_SYS_accept, server_fd));
+
+    bench::run("socket_ping_pong", 1000, [fd] {
+        ping(fd, fd);
+    });
+    stop_echo(fd, pid);
+    EXPECT(system::syscall(UB_SYS_close, fd));
+    EXPECT(system::syscall(UB_SYS_close, server_fd));
+}
+
+size_t ipc_echo() {
+    core::EventLoop event_loop;
+    ipc::Server<ipc::Client> server(event_loop, k_ipc_path);
+    server.set_on_message([](ipc::Client &client, ipc::MessageDecoder &decoder) {
+        if (decoder.decode<EchoKind>() == EchoKind::Exit) {
+            core::exit(0);
+        }
+        client.send_message<EchoMessage>();
+        return true;
+    });
+    return event_loop.run();
+}
+
+// Synchronous round trips through an ipc::Server, first as a separate send and wait, and then as a single call.
+void bench_ipc() {
+    const auto pid = spawn("ipc-echo");
+    ipc::Client client;
+    ENSURE(client.connect(k_ipc_path));
+
+    bench::run("ipc_send_wait", 1000, [&] {
+        client.send_message<EchoMessage>();
+        client.wait_message<EchoMessage>();
+    });
+    bench::run("ipc_call", 1000, [&] {
+        client.call<EchoMessage, EchoMessage>();
+    });
+    client.send_message<EchoMessage>(EchoKind::Exit);
+    EXPECT(core::wait_pid(pid));
+}
+
+void bench_regions() {
+    bench::run("allocate_region", 1000, [] {
+        auto *region = EXPECT(system::syscall<uint8_t *>(UB_SYS_allocate_region, 64_KiB, UB_MEMORY_PROT_WRITE));
+        EXPECT(system::syscall(UB_SYS_free_region, region, 64_KiB));
+    });
+
+    // Touch every page so that the page faults and frame allocations of lazily backed memory are included.
+    bench::run("allocate_region_touch", 16, [] {
+        auto *region = EXPECT(system::syscall<uint8_t *>(UB_SYS_allocate_region, 1_MiB, UB_MEMORY_PROT_WRITE));
+        for (size_t offset = 0; offset < 1_MiB; offset += 4_KiB) {
+            region[offset] = 1;
+        }
+        EXPECT(system::syscall(UB_SYS_free_region, region, 1_MiB));
+    });
+}
+
+// Lookups, gap searches and page faults with thousands of regions in the address space, which should cost about the
+// same as with only a few.
+void bench_many_regions() {
+    constexpr size_t region_count = 4096;
+    ustd::Vector<uint8_t *> regions;
+    regions.ensure_capacity(region_count);
+    for (size_t i = 0; i < region_count; i++) {
+        regions.push(EXPECT(system::syscall<uint8_t *>(UB_SYS_allocate_region, 4_KiB, UB_MEMORY_PROT_WRITE)));
+    }
+
+    // Step through the regions with an odd stride so that consecutive lookups land in different parts of the tree.
+    size_t index = 0;
+    bench::run("many_regions_virt_to_phys", 1000, [&] {
+        index = (index + 997) % region_count;
+        EXPECT(system::syscall(UB_SYS_virt_to_phys, regions[index]));
+    });
+    bench::run("many_regions_allocate_touch", 1000, [] {
+        auto *region = EXPECT(system::syscall<uint8_t *>(UB_SYS_allocate_region, 4_KiB, UB_MEMORY_PROT_WRITE));
+        region[0] = 1;
+        EXPECT(system::syscall(UB_SYS_free_region, region, 4_KiB));
+    });
+    for (auto *region : regions) {
+        EXPECT(system::syscall(UB_SYS_free_region, region, 4_KiB));
+    }
+}
+
+// Allocates and frees frames with more and more of memory already in use. The fill levels are absolute, as there's no
+// way to query the amount of memory, and sized for the 128 MiB QEMU gives us by default.
+void bench_frame_fill() {
+    ustd::Vector<uint8_t *> fill;
+    for (size_t level = 0; level < 4; level++) {
+        if (level != 0) {
+            auto *region = EXPECT(system::syscall<uint8_t *>(UB_SYS_allocate_region, 16_MiB, UB_MEMORY_PROT_WRITE));
+            for (size_t offset = 0; offset < 16_MiB; offset += 4_KiB) {
+                region[offset] = 1;
+            }
+            fill.push(region);
+        }
+        bench::run(ustd::format("frame_alloc_fill_{}m", level * 16), 16, [] {
+            auto *region = EXPECT(system::syscall<uint8_t *>(UB_SYS_allocate_region, 256_KiB, UB_MEMORY_PROT_WRITE));
+            for (size_t offset = 0; offset < 256_KiB; offset += 4_KiB) {
+                region[offset] = 1;
+            }
+            EXPECT(system::syscall(UB_SYS_free_region, region, 256_KiB));
+        });
+    }
+    for (auto *region : fill) {
+        EXPECT(system::syscall(UB_SYS_free_region, region, 16_MiB));
+    }
+}
+
+// Runs the heap stress children with increasing parallelism. All of them are started at once, and the time until the
+// last one exits gives the kernel heap throughput for that many cores.
+void bench_heap_stress() {
+    for (size_t process_count : ustd::Array<size_t, 3>{1, 2, 4}) {
+        auto start = EXPECT(core::create_pipe());
+        ustd::Vector<size_t> pids;
+        for (size_t i = 0; i < process_count; i++) {
+            ustd::Vector<ub_fd_pair_t> copy_fds;
+            copy_fds.push({start.read_fd(), k_echo_in_fd});
+            pids.push(spawn("heap-stress", ustd::move(copy_fds)));
+        }
+        start.close_read();
+
+        // NOLINTNEXTLINE
+        ustd::Array<uint8_t, 4> start_bytes{};
+        const auto start_time = core::time();
+        EXPECT(system::syscall(UB_SYS_write, start.write_fd(), start_bytes.data(), process_count));
+        for (auto pid : pids) {
+            EXPECT(core::wait_pid(pid));
+        }
+        const auto time = core::time() - start_time;
+        const auto name = ustd::format("heap_stress_{}", process_count);
+        bench::report_rate(name, process_count * k_heap_stress_doorbells, time);
+    }
+}
+
+} // namespace
+
+size_t main(size_t argc, const char **argv) {
+    // Modes used by the children of the benchmarks below.
+    if (argc > 1) {
+        const ustd::StringView mode(argv[1]);
+        if (mode == "exit") {
+            return 0;
+        }
+        if (mode == "pipe-echo" || mode == "poll-echo") {
+            return echo(k_echo_in_fd, k_echo_out_fd, mode == "poll-echo");
+        }
+        if (mode == "pipe-sink") {
+            return sink(k_echo_in_fd);
+        }
+        if (mode == "heap-stress") {
+            return heap_stress(k_echo_in_fd);
+        }
+        if (mode == "ipc-echo") {
+            return ipc_echo();
+        }
+        if (mode == "socket-echo") {
+            const auto fd = EXPECT(system::syscall<uint32_t>(UB_SYS_connect, k_socket_path));
+            return echo(fd, fd, false);
+        }
+        ENSURE_NOT_REACHED("Unknown bench mode");
+    }
+
+    // The run-bench target installs us in place of system-server, in which case nothing has mounted /run yet.
+    if (argc == 1 && ustd::StringView(argv[0]) == "/bin/system-server") {
+        EXPECT(core::mount("/run", "ram"));
+    }
+
+    bench::run("getpid", 10000, [] {
+        EXPECT(system::syscall(UB_SYS_getpid));
+    });
+    bench_pipe_ping_pong(false);
+    bench_pipe_ping_pong(true);
+    bench_pipe_throughput();
+    bench_socket_ping_pong();
+    bench_ipc();
+    bench::run("spawn_exit", 4, [] {
+        EXPECT(core::wait_pid(spawn("exit")));
+    });
+    bench_regions();
+    bench_many_regions();
+    bench_frame_fill();
+    bench_heap_stress();
+    bench::finish();
+    return 0;
+}
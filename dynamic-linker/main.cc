@@ -7,8 +7,24 @@
 #include <ustd/try.hh>
 #include <ustd/types.hh>
 
+namespace {
+
+ub_memory_prot_t segment_prot(elf::SegmentFlags flags) {
+    auto prot = UB_MEMORY_PROT_NONE;
+    if ((flags & elf::SegmentFlags::Writable) == elf::SegmentFlags::Writable) {
+        prot = prot | UB_MEMORY_PROT_WRITE;
+    }
+    if ((flags & elf::SegmentFlags::Executable) == elf::SegmentFlags::Executable) {
+        prot = prot | UB_MEMORY_PROT_EXEC;
+    }
+    return prot;
+}
+
+} // namespace
+
 size_t main(size_t argc, const char **argv) {
     auto file = EXPECT(core::File::open(argv[0]));
+    const size_t file_size = EXPECT(file.size());
     auto header = EXPECT(file.read<elf::Header>());
 
     uintptr_t region_base = ustd::Limits<uintptr_t>::max();
@@ -23,9 +39,14 @@ size_t main(size_t argc, const char **argv) {
         }
     }
 
-    // TODO: Don't always allocate writable + executable.
-    auto base_offset = EXPECT(system::syscall<uintptr_t>(UB_SYS_allocate_region, region_end - region_base,
-                                                         UB_MEMORY_PROT_WRITE | UB_MEMORY_PROT_EXEC));
+    // Find a free range of address space big enough for the whole image and release it again, so that each segment can
+    // be mapped at a fixed position within it.
+    region_base = ustd::align_down(region_base, 4_KiB);
+    const size_t image_size = ustd::align_up(region_end - region_base, 4_KiB);
+    const auto image_base =
+        EXPECT(system::syscall<uintptr_t>(UB_SYS_allocate_region, image_size, UB_MEMORY_PROT_NONE));
+    EXPECT(system::syscall(UB_SYS_free_region, image_base, image_size));
+    const uintptr_t base_offset = image_base - region_base;
     size_t dynamic_entry_count = 0;
     size_t dynamic_table_offset = 0;
     for (uint16_t i = 0; i < header.ph_count; i++) {
@@ -36,9 +57,21 @@ size_t main(size_t argc, const char **argv) {
             dynamic_entry_count = phdr.filesz / sizeof(elf::DynamicEntry);
             dynamic_table_offset = phdr.offset;
         } else if (phdr.type == elf::SegmentType::Load) {
-            // TODO: Only bother zeroing bss.
-            __builtin_memset(reinterpret_cast<void *>(base_offset + phdr.vaddr), 0, phdr.memsz);
-            EXPECT(file.read({reinterpret_cast<void *>(base_offset + phdr.vaddr), phdr.filesz}, phdr.offset));
+            // Map the segment privately from the file, writable for now so that relocations can be applied.
+            const size_t page_offset = phdr.vaddr & 0xfffu;
+            ASSERT((phdr.offset & 0xfffu) == page_offset);
+            const size_t segment_size = ustd::align_up(phdr.memsz + page_offset, 4_KiB);
+            const auto prot = segment_prot(phdr.flags) | UB_MEMORY_PROT_WRITE;
+            EXPECT(file.mmap(phdr.offset - page_offset, segment_size, prot, UB_MMAP_FLAG_FIXED,
+                             base_offset + phdr.vaddr - page_offset));
+
+            // Anything between the end of the segment's file data and the end of the file is mapped from the file too,
+            // but belongs to bss, so zero it.
+            const size_t zero_end = ustd::min(phdr.memsz, file_size - phdr.offset);
+            if (zero_end > phdr.filesz) {
+                __builtin_memset(reinterpret_cast<void *>(base_offset + phdr.vaddr + phdr.filesz), 0,
+                                 zero_end - phdr.filesz);
+            }
         }
     }
 
@@ -99,6 +132,18 @@ size_t main(size_t argc, const char **argv) {
         }
     }
 
+    // Drop write access from segments that only needed it for relocation.
+    for (uint16_t i = 0; i < header.ph_count; i++) {
+        elf::ProgramHeader phdr{};
+        EXPECT(file.read({&phdr, sizeof(elf::ProgramHeader)}, header.ph_off + header.ph_size * i));
+        if (phdr.type == elf::SegmentType::Load &&
+            (phdr.flags & elf::SegmentFlags::Writable) != elf::SegmentFlags::Writable) {
+            const size_t page_offset = phdr.vaddr & 0xfffu;
+            EXPECT(system::syscall(UB_SYS_protect_region, base_offset + phdr.vaddr - page_offset,
+                                   phdr.memsz + page_offset, segment_prot(phdr.flags)));
+        }
+    }
+
     const uintptr_t entry_point = base_offset + header.entry;
     reinterpret_cast<void (*)(size_t, const char **)>(entry_point)(argc - 1, &argv[1]);
     ENSURE_NOT_REACHED();
@@ -13,6 +13,11 @@ typedef struct ub_fb_info {
     uint32_t height;
 } ub_fb_info_t;
 
+typedef struct ub_iovec {
+    void *data;
+    size_t size;
+} ub_iovec_t;
+
 typedef struct ub_pci_bar {
     uintptr_t address;
     size_t size;
@@ -46,17 +51,44 @@ typedef enum ub_ioctl_request {
 } ub_ioctl_request_t;
 
 typedef enum ub_memory_prot {
+    UB_MEMORY_PROT_NONE = 0,
     UB_MEMORY_PROT_WRITE = 1u << 0u,
     UB_MEMORY_PROT_EXEC = 1u << 1u,
     UB_MEMORY_PROT_UNCACHEABLE = 1u << 2u,
 } ub_memory_prot_t;
 
+typedef enum ub_mmap_flags {
+    UB_MMAP_FLAG_NONE = 0,
+    UB_MMAP_FLAG_SHARED = 1u << 0u,
+    UB_MMAP_FLAG_FIXED = 1u << 1u,
+} ub_mmap_flags_t;
+
 typedef enum ub_open_mode {
     UB_OPEN_MODE_NONE = 0,
     UB_OPEN_MODE_CREATE = 1u << 0u,
     UB_OPEN_MODE_TRUNCATE = 1u << 1u,
 } ub_open_mode_t;
 
+typedef enum ub_priority {
+    UB_PRIORITY_BATCH,
+    UB_PRIORITY_NORMAL,
+    UB_PRIORITY_INTERACTIVE,
+    UB_PRIORITY_REAL_TIME,
+} ub_priority_t;
+
+// The kernel maps a read-only time page at this address into every user process. Readers must retry if the sequence
+// number was odd or changed during the read. A zero tsc_scale means that the TSC isn't usable and that UB_SYS_gettime
+// must be used instead. Otherwise, the time since boot in ns is ((tsc * tsc_scale) >> tsc_shift) + tsc_offsets[cpu],
+// where tsc and cpu are the values returned by rdtscp.
+#define UB_TIME_PAGE_ADDRESS 0x50000000000ul
+
+typedef struct ub_time_page {
+    uint32_t sequence;
+    uint32_t tsc_shift;
+    uint64_t tsc_scale;
+    uint64_t tsc_offsets[64]; // NOLINT
+} ub_time_page_t;
+
 typedef enum ub_seek_mode {
     UB_SEEK_MODE_ADD,
     UB_SEEK_MODE_SET,
@@ -68,6 +100,14 @@ inline constexpr ub_poll_events_t operator|(ub_poll_events_t lhs, ub_poll_events
     return static_cast<ub_poll_events_t>(static_cast<uint32_t>(lhs) | static_cast<uint32_t>(rhs));
 }
 
+inline constexpr ub_memory_prot_t operator|(ub_memory_prot_t lhs, ub_memory_prot_t rhs) {
+    return static_cast<ub_memory_prot_t>(static_cast<uint32_t>(lhs) | static_cast<uint32_t>(rhs));
+}
+
+inline constexpr ub_mmap_flags_t operator|(ub_mmap_flags_t lhs, ub_mmap_flags_t rhs) {
+    return static_cast<ub_mmap_flags_t>(static_cast<uint32_t>(lhs) | static_cast<uint32_t>(rhs));
+}
+
 inline constexpr ub_open_mode_t operator|(ub_open_mode_t lhs, ub_open_mode_t rhs) {
     return static_cast<ub_open_mode_t>(static_cast<uint32_t>(lhs) | static_cast<uint32_t>(rhs));
 }
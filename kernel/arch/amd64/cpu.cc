@@ -7,7 +7,9 @@
 #include <kernel/arch/amd64/register_state.hh>
 #include <kernel/dmesg.hh>
 #include <kernel/mem/address_space.hh>
+#include <kernel/mem/heap.hh>
 #include <kernel/mem/memory_manager.hh>
+#include <kernel/mem/region.hh>
 #include <kernel/proc/process.hh>
 #include <kernel/proc/scheduler.hh>
 #include <kernel/proc/thread.hh>
@@ -15,6 +17,7 @@
 #include <ustd/array.hh>
 #include <ustd/assert.hh>
 #include <ustd/atomic.hh>
+#include <ustd/numeric.hh>
 #include <ustd/try.hh>
 #include <ustd/types.hh>
 
@@ -39,6 +42,11 @@ struct CpuStorage {
     Tss tss{};
     uint32_t apic_id{0};
     uint32_t index{0};
+    HeapCache heap_cache{};
+    FrameCache frame_cache{};
+    AddressSpace *address_space{nullptr};
+    uintptr_t fs_base{0};
+    Thread *simd_owner{nullptr};
 
     static CpuStorage &current();
     static CpuStorage &from_index(uint32_t index);
@@ -128,12 +136,16 @@ ustd::Array<InterruptHandler, 256> s_interrupt_table;
 CpuStorage *s_cpu_storage_list = nullptr;
 Idt *s_idt = nullptr;
 
-// TODO: Support more than 64 CPUs.
 ustd::Atomic<uint64_t, ustd::memory_order_seq_cst> s_online_cpu_set;
 ustd::Atomic<uint32_t> s_total_cpu_count;
 uint32_t s_ticks_in_one_ms = 0;
+uint64_t s_tsc_ticks_in_one_ms = 0;
+bool s_tsc_deadline_available = false;
 uint8_t *s_simd_default_region = nullptr;
 uint32_t s_simd_region_size = 0;
+uint64_t s_xsave_mask = 0;
+bool s_xsaveopt_available = false;
+bool s_rdtscp_available = false;
 bool s_smap_available = false;
 bool s_smep_available = false;
 bool s_umip_available = false;
@@ -180,6 +192,41 @@ void handle_fault(RegisterState *regs) {
     Scheduler::switch_next(regs);
 }
 
+void handle_device_not_available(RegisterState *regs) {
+    // CR0.TS is set whenever a user thread is switched to without its SIMD state loaded, so we end up here on its first
+    // SIMD instruction. The kernel itself is built without SIMD.
+    if ((regs->cs & 0b11u) == 0u) {
+        ENSURE_NOT_REACHED("SIMD use in ring 0!");
+    }
+
+    // The previous owner's state was saved when it was switched out, so it can just be overwritten.
+    auto &cpu_storage = CpuStorage::current();
+    auto &thread = Thread::current();
+    asm volatile("clts");
+    asm volatile("xrstor %0" : : "m"(*thread.simd_region()), "a"(s_xsave_mask), "d"(s_xsave_mask >> 32u));
+    cpu_storage.simd_owner = &thread;
+    thread.set_simd_cpu(cpu_storage.index);
+}
+
+void handle_page_fault(RegisterState *regs) {
+    // Try to lazily back the page first. Note that we use the currently active address space rather than the current
+    // thread's, since the kernel may be writing to another process' memory, for example in Thread::exec.
+    auto access = RegionAccess::None;
+    if ((regs->error_code & (1u << 1u)) != 0u) {
+        access |= RegionAccess::Writable;
+    }
+    if ((regs->error_code & (1u << 2u)) != 0u) {
+        access |= RegionAccess::UserAccessible;
+    }
+    if ((regs->error_code & (1u << 4u)) != 0u) {
+        access |= RegionAccess::Executable;
+    }
+    auto *address_space = CpuStorage::current().address_space;
+    if (address_space == nullptr || !address_space->handle_fault(read_cr2(), access)) {
+        handle_fault(regs);
+    }
+}
+
 void halt_cpu(RegisterState *regs) {
     auto &cpu_storage = CpuStorage::current();
 
@@ -236,6 +283,26 @@ bool try_broadcast_halt() {
     return ustd::popcount(s_online_cpu_set.load()) == 1;
 }
 
+void configure_timer() {
+    if (s_tsc_deadline_available) {
+        // Use TSC-deadline mode. The mode switch must complete before any write to the deadline MSR.
+        write_msr(0x832, 0xec | (0b10u << 17u));
+        asm volatile("mfence" ::: "memory");
+        return;
+    }
+
+    // Otherwise use a 16x divisor in one-shot mode.
+    write_msr(0x83e, 0b11);
+    write_msr(0x832, 0xec);
+}
+
+// Converts a delay to timer ticks, clamping the delay first so that the multiplication can't overflow. Delays cut short
+// this way just make the scheduler rearm the timer when it fires.
+uint64_t timer_ticks(uint64_t ns, uint64_t ticks_in_one_ms) {
+    ns = ustd::min(ns, ~uint64_t(0) / ustd::max(ticks_in_one_ms, uint64_t(1)));
+    return ns * ticks_in_one_ms / 1000000u;
+}
+
 void setup_cpu(uint32_t index) {
     // Load the shared IDT.
     ASSERT(s_idt != nullptr);
@@ -282,9 +349,13 @@ void setup_cpu(uint32_t index) {
     // Acknowledge any outstanding stale interrupts.
     write_msr(0x80b, 0);
 
-    // Configure the APIC timer to interrupt vector 0xec with a 16x divisor in one-shot mode.
-    write_msr(0x83e, 0b11);
-    write_msr(0x832, 0xec);
+    // Configure the APIC timer to interrupt vector 0xec.
+    configure_timer();
+
+    // Store our index in TSC_AUX so that user processes can find their CPU's TSC offset with rdtscp.
+    if (s_rdtscp_available) {
+        write_msr(0xc0000103, index);
+    }
 
     // Store our x2APIC id.
     cpu_storage->apic_id = read_msr(0x802) & 0xffffffffu;
@@ -322,14 +393,16 @@ void setup_cpu(uint32_t index) {
     efer |= 1u << 11u; // Set NXE; enable no-execute page flag
     write_msr(0xc0000080, efer);
 
-    // Enable xsave x87, 128-bit, and 256-bit (if available) state saving.
-    // TODO: Use xsaveopt if available.
+    // Enable xsave x87, 128-bit, and 256-bit (if available) state saving. xsaveopt skips writing out state components
+    // which are unmodified since the last xrstor or are in their initial configuration.
     const auto xcr_supported = CpuId(0xd).eax();
     uint64_t xcr_value = 0b11u;
     if ((xcr_supported & (1u << 2u)) != 0u) {
         xcr_value |= 1u << 2u;
     }
     write_xcr0(xcr_value);
+    s_xsave_mask = xcr_value;
+    s_xsaveopt_available = (CpuId(0xd, 1).eax() & 1u) != 0u;
 
     // Write selectors to the STAR MSR. First write the sysret CS and SS (63:48), then write the syscall CS and SS
     // (47:32). The bottom 32 bits for the target EIP are not used in long mode. 0x13 is used for the sysret CS/SS pair
@@ -377,6 +450,7 @@ bool try_start_ap(uint32_t apic_id) {
 
 extern "C" void ap_entry() {
     setup_cpu(s_total_cpu_count.fetch_add(1));
+    TimeManager::synchronise_cpu();
     sched_start(nullptr);
 }
 
@@ -388,11 +462,39 @@ extern "C" void interrupt_handler(RegisterState *regs) {
     s_interrupt_table[regs->int_num](regs);
 }
 
+uint32_t cpu_count() {
+    return s_total_cpu_count.load(ustd::memory_order_acquire);
+}
+
 uint32_t current_cpu() {
     // TODO: Would probably be faster to read from GS directly.
     return CpuStorage::current().index;
 }
 
+FrameCache *frame_cache() {
+    // Frames are allocated before the CPU local storage of the BSP has been set up.
+    if (!s_bsp_initialised) {
+        return nullptr;
+    }
+    return &CpuStorage::current().frame_cache;
+}
+
+FrameCache *frame_cache(uint32_t cpu) {
+    return &CpuStorage::from_index(cpu).frame_cache;
+}
+
+HeapCache *heap_cache() {
+    // The heap is used before the CPU local storage of the BSP has been set up.
+    if (!s_bsp_initialised) {
+        return nullptr;
+    }
+    return &CpuStorage::current().heap_cache;
+}
+
+HeapCache *heap_cache(uint32_t cpu) {
+    return &CpuStorage::from_index(cpu).heap_cache;
+}
+
 void bsp_init(const acpi::RootTable *xsdt) {
     CpuId standard_features(0x1);
     if ((standard_features.ecx() & (1u << 21u)) == 0u) {
@@ -421,6 +523,7 @@ void bsp_init(const acpi::RootTable *xsdt) {
     if ((amd_extended_features.edx() & (1u << 26u)) == 0u) {
         ENSURE_NOT_REACHED("1 GiB pages not available!");
     }
+    s_rdtscp_available = (amd_extended_features.edx() & (1u << 27u)) != 0u;
 
     CpuId intel_extended_features(0x7);
     s_smap_available = (intel_extended_features.ebx() & (1u << 20u)) != 0u;
@@ -448,18 +551,19 @@ void bsp_init(const acpi::RootTable *xsdt) {
     ustd::fill(s_interrupt_table, &unhandled_interrupt);
 
     // Wire some exception handlers.
-    wire_interrupt(0, handle_fault);  // Divide by zero
-    wire_interrupt(1, handle_fault);  // Debug
-    wire_interrupt(2, halt_cpu);      // NMI
-    wire_interrupt(3, handle_fault);  // Breakpoint
-    wire_interrupt(4, handle_fault);  // Overflow
-    wire_interrupt(5, handle_fault);  // Bound range
-    wire_interrupt(6, handle_fault);  // Invalid opcode
-    wire_interrupt(13, handle_fault); // GP fault
-    wire_interrupt(14, handle_fault); // Page fault
-    wire_interrupt(17, handle_fault); // x87 FP exception
-    wire_interrupt(19, handle_fault); // SIMD FP exception
-    wire_interrupt(0xf8, halt_cpu);   // IPI halt interrupt
+    wire_interrupt(0, handle_fault);                // Divide by zero
+    wire_interrupt(1, handle_fault);                // Debug
+    wire_interrupt(2, halt_cpu);                    // NMI
+    wire_interrupt(3, handle_fault);                // Breakpoint
+    wire_interrupt(4, handle_fault);                // Overflow
+    wire_interrupt(5, handle_fault);                // Bound range
+    wire_interrupt(6, handle_fault);                // Invalid opcode
+    wire_interrupt(7, handle_device_not_available); // Device not available
+    wire_interrupt(13, handle_fault);               // GP fault
+    wire_interrupt(14, handle_page_fault);          // Page fault
+    wire_interrupt(17, handle_fault);               // x87 FP exception
+    wire_interrupt(19, handle_fault);               // SIMD FP exception
+    wire_interrupt(0xf8, halt_cpu);                 // IPI halt interrupt
 
     // Very simple TLB flush handler.
     wire_interrupt(0xf7, [](RegisterState *) {
@@ -467,8 +571,7 @@ void bsp_init(const acpi::RootTable *xsdt) {
         write_cr3(read_cr3());
     });
 
-    // Allocate for a maximum of 64 CPUs.
-    s_cpu_storage_list = new CpuStorage[64];
+    s_cpu_storage_list = new CpuStorage[k_max_cpu_count];
     s_online_cpu_set.store(0);
     s_total_cpu_count.store(1);
 
@@ -478,15 +581,30 @@ void bsp_init(const acpi::RootTable *xsdt) {
     // Start the APIC timer counting down from its max value.
     write_msr(0x838, 0xffffffff);
 
-    // Spin for 1 ms and then calculate the total number of ticks occured in that time by the APIC timer.
-    TimeManager::spin(1);
-    s_ticks_in_one_ms = 0xffffffff - read_msr(0x839);
+    // Spin for 10 ms and then calculate the number of ticks occured in one ms by both the APIC timer and the TSC.
+    const auto tsc_start = read_cycle_counter();
+    TimeManager::spin(10);
+    const auto tsc_end = read_cycle_counter();
+    s_ticks_in_one_ms = (0xffffffff - read_msr(0x839)) / 10;
+    write_msr(0x838, 0);
+
+    // The TSC can only be used as a clock if it ticks at a constant rate regardless of power state, in which case the
+    // HPET is only needed for the calibration above. rdtscp is also required so that user processes can read the time
+    // from the time page. The TSC-deadline timer mode is then also used if available, since it saves converting and
+    // clamping deadlines to APIC timer ticks.
+    const bool invariant_tsc = CpuId(0x80000000).eax() >= 0x80000007 && (CpuId(0x80000007).edx() & (1u << 8u)) != 0u;
+    if (invariant_tsc && s_rdtscp_available) {
+        s_tsc_ticks_in_one_ms = (tsc_end - tsc_start) / 10;
+        s_tsc_deadline_available = (standard_features.ecx() & (1u << 24u)) != 0u;
+        TimeManager::enable_tsc(s_tsc_ticks_in_one_ms);
+        configure_timer();
+    }
 
     // Reinitialise FP state and save a default xsave region.
     s_simd_region_size = CpuId(0xd).ebx();
     s_simd_default_region = new (ustd::align_val_t(64)) uint8_t[s_simd_region_size];
     asm volatile("fninit");
-    asm volatile("xsave %0" : "=m"(*s_simd_default_region) : "a"(0xffffffffu), "d"(0xffffffffu));
+    asm volatile("xsave %0" : "=m"(*s_simd_default_region) : "a"(s_xsave_mask), "d"(s_xsave_mask >> 32u));
 
     s_bsp_initialised = true;
 }
@@ -517,7 +635,7 @@ void smp_init(const acpi::RootTable *xsdt) {
             continue;
         }
 
-        if (s_total_cpu_count.load() == 64) {
+        if (s_total_cpu_count.load() == k_max_cpu_count) {
             break;
         }
 
@@ -546,7 +664,7 @@ void smp_init(const acpi::RootTable *xsdt) {
     }
 
     // Start the timer.
-    timer_set_one_shot(1);
+    timer_set_one_shot(1000000);
 
     // Main idle loop.
     while (true) {
@@ -554,19 +672,28 @@ void smp_init(const acpi::RootTable *xsdt) {
     }
 }
 
+void send_reschedule_ipi(uint32_t cpu) {
+    // The scheduler's timer vector doubles as the reschedule vector.
+    send_ipi(0xec, IpiType::Fixed, IpiDestination::make_physical(CpuStorage::from_index(cpu).apic_id));
+}
+
 void switch_space(AddressSpace &address_space) {
     const auto pml4_address = ustd::bit_cast<uintptr_t>(address_space.pml4_ptr());
     if (read_cr3() != pml4_address) {
         write_pml4(pml4_address);
     }
+    CpuStorage::current().address_space = &address_space;
 }
 
 void thread_init(Thread *thread) {
-    auto *simd_region = new (ustd::align_val_t(64)) uint8_t[s_simd_region_size];
-    __builtin_memcpy(simd_region, s_simd_default_region, s_simd_region_size);
-    thread->set_simd_region(simd_region);
-
+    // Kernel and idle threads never touch SIMD, so they don't need an xsave region.
     const bool is_kernel = thread->process().is_kernel();
+    if (!is_kernel) {
+        auto *simd_region = new (ustd::align_val_t(64)) uint8_t[s_simd_region_size];
+        __builtin_memcpy(simd_region, s_simd_default_region, s_simd_region_size);
+        thread->set_simd_region(simd_region);
+    }
+
     thread->register_state().cs = is_kernel ? 0x08u : (0x20u | 0x3u);
     thread->register_state().ss = is_kernel ? 0x10u : (0x18u | 0x3u);
     thread->register_state().rflags = 0x202u;
@@ -581,22 +708,63 @@ void thread_init(Thread *thread) {
 
 void thread_load(RegisterState *state, Thread *thread) {
     __builtin_memcpy(state, &thread->register_state(), sizeof(RegisterState));
-    asm volatile("xrstor %0" : : "m"(*thread->simd_region()), "a"(0xffffffffu), "d"(0xffffffffu));
 
+    // SIMD state is restored lazily. If the thread's state is still live in this CPU's registers, which is common when
+    // only kernel or idle threads ran in between, it can be used as is. Otherwise set CR0.TS so that the first SIMD
+    // instruction traps into handle_device_not_available. Kernel threads leave the registers and CR0.TS alone.
     auto &cpu_storage = CpuStorage::current();
+    if (!thread->process().is_kernel()) {
+        const uint64_t cr0 = read_cr0();
+        if (cpu_storage.simd_owner == thread && thread->simd_cpu() == cpu_storage.index) {
+            if ((cr0 & (1u << 3u)) != 0u) {
+                asm volatile("clts");
+            }
+        } else if ((cr0 & (1u << 3u)) == 0u) {
+            write_cr0(cr0 | (1u << 3u));
+        }
+    }
+
     cpu_storage.current_thread = thread;
     cpu_storage.kernel_stack = thread->kernel_stack();
+
+    // The FS base holds the thread's TLS pointer. Writing the MSR is slow, so skip it if it's unchanged.
+    if (cpu_storage.fs_base != thread->tls_base()) {
+        write_msr(0xc0000100, thread->tls_base());
+        cpu_storage.fs_base = thread->tls_base();
+    }
 }
 
 void thread_save(RegisterState *state) {
     auto &thread = Thread::current();
     __builtin_memcpy(&thread.register_state(), state, sizeof(RegisterState));
-    asm volatile("xsave %0" : "=m"(*thread.simd_region()) : "a"(0xffffffffu), "d"(0xffffffffu));
+
+    // The SIMD state only needs saving if the thread has used it since being switched to (CR0.TS clear). It must still
+    // be saved eagerly since the thread may be picked up by another CPU.
+    if (thread.process().is_kernel() || (read_cr0() & (1u << 3u)) != 0u) {
+        return;
+    }
+    if (s_xsaveopt_available) {
+        asm volatile("xsaveopt %0" : "+m"(*thread.simd_region()) : "a"(s_xsave_mask), "d"(s_xsave_mask >> 32u));
+    } else {
+        asm volatile("xsave %0" : "+m"(*thread.simd_region()) : "a"(s_xsave_mask), "d"(s_xsave_mask >> 32u));
+    }
+}
+
+void timer_cancel() {
+    // Writing a deadline or initial count of zero stops the timer.
+    write_msr(s_tsc_deadline_available ? 0x6e0 : 0x838, 0);
 }
 
-void timer_set_one_shot(uint32_t ms) {
-    // Set initial timer count.
-    write_msr(0x838, ms * s_ticks_in_one_ms);
+void timer_set_one_shot(uint64_t ns) {
+    if (s_tsc_deadline_available) {
+        write_msr(0x6e0, read_cycle_counter() + timer_ticks(ns, s_tsc_ticks_in_one_ms));
+        return;
+    }
+
+    // Set initial timer count, making sure not to write zero. Delays too long for the counter are cut short, in which
+    // case the scheduler will just rearm the timer when it fires.
+    const uint64_t ticks = timer_ticks(ns, s_ticks_in_one_ms);
+    write_msr(0x838, ustd::min(ustd::max(ticks, uint64_t(1)), uint64_t(0xffffffff)));
 }
 
 // TODO: Send these parameters to other CPUs with the IPI to avoid a full flush.
@@ -2,10 +2,24 @@
 
 // IWYU pragma: private, include <kernel/arch/cpu.hh>
 
+#include <kernel/arch/amd64/register_state.hh>
+#include <ustd/types.hh>
+
 namespace kernel::arch {
 
+inline bool is_user_mode(const RegisterState &regs) {
+    return (regs.cs & 0x3u) != 0u;
+}
+
 inline void cpu_relax() {
     asm volatile("pause" ::: "memory");
 }
 
+inline uint64_t read_cycle_counter() {
+    uint32_t eax = 0;
+    uint32_t edx = 0;
+    asm volatile("rdtsc" : "=a"(eax), "=d"(edx));
+    return (static_cast<uint64_t>(edx) << 32u) | eax;
+}
+
 } // namespace kernel::arch
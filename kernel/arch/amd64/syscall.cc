@@ -1,4 +1,5 @@
 #include <kernel/proc/process.hh>
+#include <kernel/proc/scheduler.hh>
 #include <kernel/proc/thread.hh>
 #include <kernel/sys_result.hh>
 #include <ustd/assert.hh>
@@ -25,7 +26,7 @@ struct SyscallFrame {
     uint64_t rax;
 };
 
-using SyscallHandler = SyscallResult (Process::*)(uint64_t, uint64_t, uint64_t);
+using SyscallHandler = SyscallResult (Process::*)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
 #define S(name, ...) reinterpret_cast<SyscallHandler>(&Process::sys_##name),
 const ustd::Array s_syscall_table{
 #include <kernel/api/syscalls.in>
@@ -42,8 +43,16 @@ extern "C" void syscall_handler(SyscallFrame *frame, Thread *thread) {
     ASSERT_PEDANTIC(thread != nullptr);
     auto *process = &thread->process();
     ASSERT_PEDANTIC(process != nullptr);
-    const auto result = (process->*s_syscall_table[frame->rax])(frame->rdi, frame->rsi, frame->rdx);
+    // Arguments are passed in rdi, rsi, rdx, r10, r8 and r9. Note that r10 is used instead of rcx since rcx is clobbered by
+    // the syscall instruction.
+    const auto result = (process->*s_syscall_table[frame->rax])(frame->rdi, frame->rsi, frame->rdx, frame->r10,
+                                                                 frame->r8, frame->r9);
     frame->rax = result.value();
+
+    // Threads of an exiting process are killed on their way back to user space.
+    if (process->exiting()) {
+        Scheduler::yield_and_kill();
+    }
 }
 
 } // namespace kernel::arch
@@ -15,6 +15,8 @@
 namespace kernel {
 
 class AddressSpace;
+struct FrameCache;
+struct HeapCache;
 class Thread;
 
 } // namespace kernel
@@ -31,15 +33,25 @@ struct RegisterState;
 
 using InterruptHandler = void (*)(RegisterState *);
 
+// TODO: Support more than 64 CPUs.
+constexpr uint32_t k_max_cpu_count = 64;
+
+uint32_t cpu_count();
 uint32_t current_cpu();
+FrameCache *frame_cache();
+FrameCache *frame_cache(uint32_t cpu);
+HeapCache *heap_cache();
+HeapCache *heap_cache(uint32_t cpu);
 void bsp_init(const acpi::RootTable *xsdt);
 void smp_init(const acpi::RootTable *xsdt);
 [[noreturn]] void sched_start(Thread *base_thread);
+void send_reschedule_ipi(uint32_t cpu);
 void switch_space(AddressSpace &address_space);
 void thread_init(Thread *thread);
 void thread_load(RegisterState *state, Thread *thread);
 void thread_save(RegisterState *state);
-void timer_set_one_shot(uint32_t ms);
+void timer_cancel();
+void timer_set_one_shot(uint64_t ns);
 void tlb_flush_range(AddressSpace &address_space, VirtualRange range);
 void vm_debug_char(char ch);
 void wire_interrupt(uint8_t vector, InterruptHandler handler);
@@ -0,0 +1,36 @@
+#include <kernel/dev/sched_info_device.hh>
+
+#include <kernel/arch/cpu.hh>
+#include <kernel/proc/scheduler.hh>
+#include <kernel/sys_result.hh>
+#include <ustd/numeric.hh>
+#include <ustd/span.hh>
+#include <ustd/string.hh>
+#include <ustd/string_builder.hh>
+#include <ustd/types.hh>
+
+namespace kernel {
+
+void SchedInfoDevice::initialise() {
+    (new SchedInfoDevice)->leak_ref();
+}
+
+SysResult<size_t> SchedInfoDevice::read(ustd::Span<void> data, size_t offset) {
+    ustd::StringBuilder builder;
+    builder.append("cpu switches cycles_per_switch migrations steals\n");
+    for (uint32_t cpu = 0; cpu < arch::cpu_count(); cpu++) {
+        const auto stats = Scheduler::stats(cpu);
+        const auto cycles_per_switch = stats.switch_count != 0 ? stats.switch_cycles / stats.switch_count : 0;
+        builder.append("{} {} {} {} {}\n", cpu, stats.switch_count, cycles_per_switch, stats.migration_count,
+                       stats.steal_count);
+    }
+    const auto report = builder.build();
+    if (offset >= report.length()) {
+        return 0u;
+    }
+    const auto size = ustd::min(data.size(), report.length() - offset);
+    __builtin_memcpy(data.data(), report.data() + offset, size);
+    return size;
+}
+
+} // namespace kernel
@@ -0,0 +1,33 @@
+#include <kernel/dev/slab_info_device.hh>
+
+#include <kernel/mem/slab_cache.hh>
+#include <kernel/sys_result.hh>
+#include <ustd/numeric.hh>
+#include <ustd/span.hh>
+#include <ustd/string.hh>
+#include <ustd/string_builder.hh>
+#include <ustd/types.hh>
+
+namespace kernel {
+
+void SlabInfoDevice::initialise() {
+    (new SlabInfoDevice)->leak_ref();
+}
+
+SysResult<size_t> SlabInfoDevice::read(ustd::Span<void> data, size_t offset) {
+    ustd::StringBuilder builder;
+    builder.append("name object_size slab_size active_objects total_objects slab_count\n");
+    for (auto *cache = SlabCache::first(); cache != nullptr; cache = cache->next()) {
+        builder.append("{} {} {} {} {} {}\n", cache->name(), cache->object_size(), cache->slab_size(),
+                       cache->active_count(), cache->total_count(), cache->slab_count());
+    }
+    const auto report = builder.build();
+    if (offset >= report.length()) {
+        return 0u;
+    }
+    const auto size = ustd::min(data.size(), report.length() - offset);
+    __builtin_memcpy(data.data(), report.data() + offset, size);
+    return size;
+}
+
+} // namespace kernel
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <kernel/dev/device.hh>
+#include <kernel/sys_result.hh>
+#include <ustd/span.hh> // IWYU pragma: keep
+#include <ustd/types.hh>
+
+namespace kernel {
+
+class SlabInfoDevice final : public Device {
+public:
+    static void initialise();
+
+    SlabInfoDevice() : Device("slabinfo") {}
+
+    bool read_would_block(size_t) const override { return false; }
+    bool write_would_block(size_t) const override { return false; }
+    SysResult<size_t> read(ustd::Span<void> data, size_t offset) override;
+};
+
+} // namespace kernel
@@ -12,6 +12,8 @@
 #include <kernel/dev/dev_fs.hh>
 #include <kernel/dev/dmesg_device.hh>
 #include <kernel/dev/framebuffer_device.hh>
+#include <kernel/dev/sched_info_device.hh>
+#include <kernel/dev/slab_info_device.hh>
 #include <kernel/dmesg.hh>
 #include <kernel/font.hh>
 #include <kernel/fs/file_system.hh>
@@ -89,6 +91,8 @@ void kernel_init(BootInfo *boot_info, acpi::RootTable *xsdt) {
     // Create and mount the device filesystem.
     DevFs::initialise();
     DmesgDevice::initialise();
+    SchedInfoDevice::initialise();
+    SlabInfoDevice::initialise();
 
     const auto *mcfg = EXPECT(xsdt->find<acpi::PciTable>());
     pci::enumerate(mcfg);
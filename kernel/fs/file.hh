@@ -2,14 +2,17 @@
 
 #include <kernel/api/types.h>
 #include <kernel/error.hh>
+#include <kernel/mem/vm_object.hh>
 #include <kernel/sys_result.hh>
 #include <ustd/shareable.hh>
+#include <ustd/shared_ptr.hh>
 #include <ustd/span.hh> // IWYU pragma: keep
 #include <ustd/types.hh>
 
 namespace kernel {
 
 class AddressSpace;
+class WaitQueue;
 
 enum class AttachDirection {
     Read,
@@ -27,6 +30,7 @@ public:
     File &operator=(const File &) = delete;
     File &operator=(File &&) = delete;
 
+    virtual bool is_doorbell() const { return false; }
     virtual bool is_inode_file() const { return false; }
     virtual bool is_pipe() const { return false; }
     virtual bool is_server_socket() const { return false; }
@@ -40,7 +44,13 @@ public:
     virtual uintptr_t mmap(AddressSpace &) const { return 0; }
     virtual SysResult<size_t> read(ustd::Span<void> data, size_t offset = 0) = 0;
     virtual SysResult<size_t> write(ustd::Span<const void> data, size_t offset = 0) = 0;
+    virtual SysResult<ustd::SharedPtr<VmObject>> vm_object() { return Error::Invalid; }
     virtual bool valid() const { return true; }
+
+    // The queues woken up when read_would_block or write_would_block may have become false. A file which can block must
+    // return a queue, otherwise threads blocked on it will never be woken.
+    virtual WaitQueue *read_wait_queue() { return nullptr; }
+    virtual WaitQueue *write_wait_queue() { return nullptr; }
 };
 
 } // namespace kernel
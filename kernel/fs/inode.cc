@@ -2,6 +2,7 @@
 
 #include <kernel/error.hh>
 #include <kernel/fs/file.hh>
+#include <kernel/mem/vm_object.hh>
 #include <kernel/scoped_lock.hh>
 #include <kernel/spin_lock.hh>
 #include <kernel/sys_result.hh>
@@ -63,4 +64,8 @@ size_t Inode::write(ustd::Span<const void>, size_t) {
     ENSURE_NOT_REACHED();
 }
 
+SysResult<ustd::SharedPtr<VmObject>> Inode::vm_object() {
+    return Error::Invalid;
+}
+
 } // namespace kernel
@@ -10,6 +10,8 @@
 
 namespace kernel {
 
+class VmObject;
+
 enum class InodeType {
     AnonymousFile,
     Directory,
@@ -45,6 +47,7 @@ public:
     virtual size_t size() const = 0;
     virtual SysResult<> truncate();
     virtual size_t write(ustd::Span<const void> data, size_t offset);
+    virtual SysResult<ustd::SharedPtr<VmObject>> vm_object();
 
     virtual ustd::StringView name() const = 0;
     Inode *parent() const { return m_parent; }
@@ -1,7 +1,9 @@
 #include <kernel/fs/inode_file.hh>
 
 #include <kernel/fs/inode.hh>
+#include <kernel/mem/vm_object.hh>
 #include <kernel/sys_result.hh>
+#include <ustd/shared_ptr.hh>
 #include <ustd/span.hh>
 #include <ustd/types.hh>
 
@@ -15,4 +17,8 @@ SysResult<size_t> InodeFile::write(ustd::Span<const void> data, size_t offset) {
     return m_inode->write(data, offset);
 }
 
+SysResult<ustd::SharedPtr<VmObject>> InodeFile::vm_object() {
+    return m_inode->vm_object();
+}
+
 } // namespace kernel
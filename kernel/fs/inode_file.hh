@@ -2,6 +2,7 @@
 
 #include <kernel/fs/file.hh>
 #include <kernel/sys_result.hh>
+#include <ustd/shared_ptr.hh>
 #include <ustd/span.hh> // IWYU pragma: keep
 #include <ustd/types.hh>
 
@@ -21,6 +22,7 @@ public:
     bool write_would_block(size_t) const override { return false; }
     SysResult<size_t> read(ustd::Span<void> data, size_t offset) override;
     SysResult<size_t> write(ustd::Span<const void> data, size_t offset) override;
+    SysResult<ustd::SharedPtr<VmObject>> vm_object() override;
 
     Inode *inode() const { return m_inode; }
 };
@@ -3,6 +3,7 @@
 #include <kernel/error.hh>
 #include <kernel/fs/inode.hh>
 #include <kernel/fs/inode_file.hh>
+#include <kernel/mem/vm_object.hh>
 #include <kernel/scoped_lock.hh>
 #include <kernel/spin_lock.hh>
 #include <kernel/sys_result.hh>
@@ -25,43 +26,73 @@ void RamFs::mount(Inode *parent, Inode *host) {
     m_root_inode.emplace(parent, host != nullptr ? host->name() : "/"sv);
 }
 
+RamFsInode::RamFsInode(InodeType type, Inode *parent, ustd::StringView name)
+    : Inode(type, parent), m_name(name), m_data(VmObject::create_lazy(0)) {}
+
 SysResult<ustd::SharedPtr<File>> RamFsInode::open_impl() {
     return ustd::make_shared<InodeFile>(this);
 }
 
 size_t RamFsInode::read(ustd::Span<void> data, size_t offset) const {
     ScopedLock locker(m_lock);
-    if (offset >= m_data.size()) {
+    if (offset >= m_size) {
         return 0;
     }
-    size_t size = data.size();
-    if (size > m_data.size() - offset) {
-        size = m_data.size() - offset;
+    const size_t size = ustd::min(data.size(), m_size - offset);
+    for (size_t position = 0; position < size;) {
+        const size_t page_offset = (offset + position) % 4_KiB;
+        const size_t chunk_size = ustd::min(4_KiB - page_offset, size - position);
+        auto *destination = static_cast<uint8_t *>(data.data()) + position;
+        if (auto phys = m_data->lookup_page((offset + position) / 4_KiB)) {
+            __builtin_memcpy(destination, reinterpret_cast<const uint8_t *>(*phys) + page_offset, chunk_size);
+        } else {
+            // Sparse hole.
+            __builtin_memset(destination, 0, chunk_size);
+        }
+        position += chunk_size;
     }
-    __builtin_memcpy(data.data(), m_data.data() + offset, size);
     return size;
 }
 
 size_t RamFsInode::size() const {
     ScopedLock locker(m_lock);
-    return m_data.size();
+    return m_size;
 }
 
 SysResult<> RamFsInode::truncate() {
-    // TODO: Clear with capacity.
+    // Existing mappings of the file keep the old pages.
     ScopedLock locker(m_lock);
-    m_data.clear();
+    m_data = VmObject::create_lazy(0);
+    m_size = 0;
     return {};
 }
 
 size_t RamFsInode::write(ustd::Span<const void> data, size_t offset) {
     ScopedLock locker(m_lock);
-    size_t size = data.size();
-    m_data.ensure_size(offset + size);
-    __builtin_memcpy(m_data.data() + offset, data.data(), size);
+
+    // Writes are cut short at the largest size the file's pages can cover.
+    if (offset >= VmObject::k_max_lazy_size) {
+        return 0;
+    }
+    const size_t size = ustd::min(data.size(), VmObject::k_max_lazy_size - offset);
+    m_data->grow(offset + size);
+    for (size_t position = 0; position < size;) {
+        const size_t page_offset = (offset + position) % 4_KiB;
+        const size_t chunk_size = ustd::min(4_KiB - page_offset, size - position);
+        const auto phys = m_data->commit_page((offset + position) / 4_KiB, true).phys;
+        __builtin_memcpy(reinterpret_cast<uint8_t *>(phys) + page_offset,
+                         static_cast<const uint8_t *>(data.data()) + position, chunk_size);
+        position += chunk_size;
+    }
+    m_size = ustd::max(m_size, offset + size);
     return size;
 }
 
+SysResult<ustd::SharedPtr<VmObject>> RamFsInode::vm_object() {
+    ScopedLock locker(m_lock);
+    return m_data;
+}
+
 SysResult<Inode *> RamFsDirectoryInode::child(size_t index) const {
     if (index >= ustd::Limits<uint32_t>::max()) {
         return Error::Invalid;
@@ -5,7 +5,7 @@
 #include <kernel/spin_lock.hh>
 #include <kernel/sys_result.hh>
 #include <ustd/optional.hh>
-#include <ustd/shared_ptr.hh> // IWYU pragma: keep
+#include <ustd/shared_ptr.hh>
 #include <ustd/span.hh>       // IWYU pragma: keep
 #include <ustd/string.hh>
 #include <ustd/string_view.hh>
@@ -16,20 +16,24 @@
 namespace kernel {
 
 class File;
+class VmObject;
 
+// A RamFs file, whose data is stored in a sparse array of pages that can be mapped directly into user address spaces.
 class RamFsInode final : public Inode {
     ustd::String m_name;
-    ustd::LargeVector<uint8_t> m_data;
+    ustd::SharedPtr<VmObject> m_data;
+    size_t m_size{0};
     mutable SpinLock m_lock;
 
 public:
-    RamFsInode(InodeType type, Inode *parent, ustd::StringView name) : Inode(type, parent), m_name(name) {}
+    RamFsInode(InodeType type, Inode *parent, ustd::StringView name);
 
     SysResult<ustd::SharedPtr<File>> open_impl() override;
     size_t read(ustd::Span<void> data, size_t offset) const override;
     size_t size() const override;
     SysResult<> truncate() override;
     size_t write(ustd::Span<const void> data, size_t offset) override;
+    SysResult<ustd::SharedPtr<VmObject>> vm_object() override;
     ustd::StringView name() const override { return m_name; }
 };
 
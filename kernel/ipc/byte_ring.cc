@@ -0,0 +1,71 @@
+#include <kernel/ipc/byte_ring.hh>
+
+#include <kernel/proc/wait_queue.hh>
+#include <kernel/scoped_lock.hh>
+#include <kernel/spin_lock.hh>
+#include <ustd/assert.hh>
+#include <ustd/atomic.hh>
+#include <ustd/numeric.hh>
+#include <ustd/span.hh>
+#include <ustd/types.hh>
+
+namespace kernel {
+
+ByteRing::ByteRing(size_t capacity) : m_data(new uint8_t[capacity]), m_capacity(capacity) {
+    ASSERT((capacity & (capacity - 1)) == 0);
+}
+
+ByteRing::~ByteRing() {
+    delete[] m_data;
+}
+
+void ByteRing::close() {
+    m_closed.store(true, ustd::memory_order_release);
+    m_read_queue.wake_all();
+    m_write_queue.wake_all();
+}
+
+size_t ByteRing::read(ustd::Span<void> data) {
+    ScopedLock locker(m_read_lock);
+    const auto head = m_head.load(ustd::memory_order_relaxed);
+    const auto size = ustd::min(data.size(), m_tail.load(ustd::memory_order_acquire) - head);
+
+    // Copy out in up to two parts if the data wraps around the end of the ring.
+    const auto offset = head & (m_capacity - 1);
+    const auto first_size = ustd::min(size, m_capacity - offset);
+    auto *destination = static_cast<uint8_t *>(data.data());
+    __builtin_memcpy(destination, m_data + offset, first_size);
+    __builtin_memcpy(destination + first_size, m_data, size - first_size);
+
+    // Publish the freed space only after copying out of it.
+    m_head.store(head + size, ustd::memory_order_release);
+    locker.unlock();
+
+    if (size != 0) {
+        m_write_queue.wake_all();
+    }
+    return size;
+}
+
+size_t ByteRing::write(ustd::Span<const void> data) {
+    ScopedLock locker(m_write_lock);
+    const auto tail = m_tail.load(ustd::memory_order_relaxed);
+    const auto size = ustd::min(data.size(), m_capacity - (tail - m_head.load(ustd::memory_order_acquire)));
+
+    const auto offset = tail & (m_capacity - 1);
+    const auto first_size = ustd::min(size, m_capacity - offset);
+    const auto *source = static_cast<const uint8_t *>(data.data());
+    __builtin_memcpy(m_data + offset, source, first_size);
+    __builtin_memcpy(m_data, source + first_size, size - first_size);
+
+    // Publish the data only after copying it in.
+    m_tail.store(tail + size, ustd::memory_order_release);
+    locker.unlock();
+
+    if (size != 0) {
+        m_read_queue.wake_all();
+    }
+    return size;
+}
+
+} // namespace kernel
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <kernel/proc/wait_queue.hh>
+#include <kernel/spin_lock.hh>
+#include <ustd/atomic.hh>
+#include <ustd/shareable.hh>
+#include <ustd/span.hh> // IWYU pragma: keep
+#include <ustd/types.hh>
+
+namespace kernel {
+
+// A ring of bytes with one reader and one writer which don't need to share a lock. The head and tail indices only ever
+// increase, and wrap around the power of two capacity when indexing. Readers and writers are each serialised by their
+// own lock, which is uncontended in the common case of a single reader and a single writer.
+class ByteRing : public ustd::Shareable<ByteRing> {
+    uint8_t *const m_data;
+    const size_t m_capacity;
+    ustd::Atomic<bool> m_closed{false};
+    WaitQueue m_read_queue;
+    WaitQueue m_write_queue;
+
+    // The reader's and the writer's state are on separate cache lines, so that a reader and a writer on different CPUs
+    // only share a line when one needs to see the other's progress.
+    alignas(64) ustd::Atomic<size_t> m_head{0};
+    SpinLock m_read_lock;
+    alignas(64) ustd::Atomic<size_t> m_tail{0};
+    SpinLock m_write_lock;
+
+public:
+    explicit ByteRing(size_t capacity);
+    ByteRing(const ByteRing &) = delete;
+    ByteRing(ByteRing &&) = delete;
+    ~ByteRing();
+
+    ByteRing &operator=(const ByteRing &) = delete;
+    ByteRing &operator=(ByteRing &&) = delete;
+
+    void close();
+    size_t read(ustd::Span<void> data);
+    size_t write(ustd::Span<const void> data);
+
+    bool closed() const { return m_closed.load(ustd::memory_order_acquire); }
+    bool empty() const { return m_tail.load(ustd::memory_order_acquire) == m_head.load(ustd::memory_order_acquire); }
+    bool full() const {
+        return m_tail.load(ustd::memory_order_acquire) - m_head.load(ustd::memory_order_acquire) == m_capacity;
+    }
+    WaitQueue &read_queue() { return m_read_queue; }
+    WaitQueue &write_queue() { return m_write_queue; }
+};
+
+} // namespace kernel
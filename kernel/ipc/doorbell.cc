@@ -0,0 +1,75 @@
+#include <kernel/ipc/doorbell.hh>
+
+#include <kernel/error.hh>
+#include <kernel/fs/file.hh>
+#include <kernel/proc/wait_queue.hh>
+#include <kernel/sys_result.hh>
+#include <ustd/assert.hh>
+#include <ustd/atomic.hh>
+#include <ustd/span.hh>
+#include <ustd/try.hh>
+#include <ustd/types.hh>
+
+namespace kernel {
+
+void Doorbell::attach(AttachDirection direction) {
+    ASSERT(direction != AttachDirection::ReadWrite);
+    if (direction == AttachDirection::Read) {
+        m_waiter_count.fetch_add(1, ustd::memory_order_acq_rel);
+    } else if (direction == AttachDirection::Write) {
+        m_ringer_count.fetch_add(1, ustd::memory_order_acq_rel);
+    }
+}
+
+void Doorbell::detach(AttachDirection direction) {
+    ASSERT(direction != AttachDirection::ReadWrite);
+    if (direction == AttachDirection::Read) {
+        [[maybe_unused]] const auto waiter_count = m_waiter_count.fetch_sub(1, ustd::memory_order_acq_rel);
+        ASSERT(waiter_count > 0);
+    } else if (direction == AttachDirection::Write) {
+        const auto ringer_count = m_ringer_count.fetch_sub(1, ustd::memory_order_acq_rel);
+        ASSERT(ringer_count > 0);
+        if (ringer_count == 1) {
+            // Any blocked waiters will now see end of file.
+            m_wait_queue.wake_all();
+        }
+    }
+}
+
+bool Doorbell::read_would_block(size_t) const {
+    return m_ringer_count.load(ustd::memory_order_acquire) != 0 && m_count.load(ustd::memory_order_acquire) == 0;
+}
+
+SysResult<size_t> Doorbell::read(ustd::Span<void> data, size_t) {
+    if (data.size() < sizeof(uint64_t)) {
+        return Error::Invalid;
+    }
+    const uint64_t count = m_count.exchange(0, ustd::memory_order_acq_rel);
+    if (count == 0 && m_ringer_count.load(ustd::memory_order_acquire) == 0) {
+        return 0u;
+    }
+    __builtin_memcpy(data.data(), &count, sizeof(uint64_t));
+    return sizeof(uint64_t);
+}
+
+SysResult<size_t> Doorbell::write(ustd::Span<const void> data, size_t) {
+    if (data.size() < sizeof(uint64_t)) {
+        return Error::Invalid;
+    }
+    uint64_t value;
+    __builtin_memcpy(&value, data.data(), sizeof(uint64_t));
+    TRY(ring(value, false));
+    return sizeof(uint64_t);
+}
+
+// With handoff set, a waiting thread is switched to directly once the caller blocks. See Scheduler::wake.
+SysResult<> Doorbell::ring(uint64_t value, bool handoff) {
+    if (m_waiter_count.load(ustd::memory_order_acquire) == 0) {
+        return Error::BrokenHandle;
+    }
+    m_count.fetch_add(value, ustd::memory_order_acq_rel);
+    m_wait_queue.wake_all(handoff);
+    return {};
+}
+
+} // namespace kernel
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <kernel/fs/file.hh>
+#include <kernel/proc/wait_queue.hh>
+#include <kernel/sys_result.hh>
+#include <ustd/atomic.hh>
+#include <ustd/span.hh> // IWYU pragma: keep
+#include <ustd/types.hh>
+
+namespace kernel {
+
+// An eventfd-like file for waking up a process which is waiting on memory shared with another. Like a pipe, it has a
+// wait (read) end and a ring (write) end. Writing a 64-bit value adds it to a counter, and reading returns the counter
+// and resets it to zero, blocking whilst it is zero. Reading gives end of file once every ring end has been closed, and
+// ringing fails once every wait end has been closed.
+class Doorbell final : public File {
+    ustd::Atomic<uint64_t> m_count{0};
+    ustd::Atomic<uint32_t> m_waiter_count{0};
+    ustd::Atomic<uint32_t> m_ringer_count{0};
+    WaitQueue m_wait_queue;
+
+public:
+    Doorbell() = default;
+    Doorbell(const Doorbell &) = delete;
+    Doorbell(Doorbell &&) = delete;
+    ~Doorbell() override = default;
+
+    Doorbell &operator=(const Doorbell &) = delete;
+    Doorbell &operator=(Doorbell &&) = delete;
+
+    bool is_doorbell() const override { return true; }
+
+    void attach(AttachDirection) override;
+    void detach(AttachDirection) override;
+    bool read_would_block(size_t offset) const override;
+    bool write_would_block(size_t) const override { return false; }
+    SysResult<size_t> read(ustd::Span<void> data, size_t offset) override;
+    SysResult<size_t> write(ustd::Span<const void> data, size_t offset) override;
+    WaitQueue *read_wait_queue() override { return &m_wait_queue; }
+
+    SysResult<> ring(uint64_t value, bool handoff);
+};
+
+} // namespace kernel
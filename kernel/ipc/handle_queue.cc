@@ -0,0 +1,24 @@
+#include <kernel/ipc/handle_queue.hh>
+
+#include <kernel/fs/file_handle.hh>
+#include <kernel/scoped_lock.hh>
+#include <ustd/optional.hh>
+#include <ustd/utility.hh>
+#include <ustd/vector.hh>
+
+namespace kernel {
+
+ustd::Optional<FileHandle> HandleQueue::pop() {
+    ScopedLock locker(m_lock);
+    if (m_handles.empty()) {
+        return {};
+    }
+    return m_handles.take(0);
+}
+
+void HandleQueue::push(FileHandle &&handle) {
+    ScopedLock locker(m_lock);
+    m_handles.push(ustd::move(handle));
+}
+
+} // namespace kernel
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <kernel/fs/file_handle.hh>
+#include <kernel/spin_lock.hh>
+#include <ustd/optional.hh>
+#include <ustd/shareable.hh>
+#include <ustd/vector.hh>
+
+namespace kernel {
+
+// A queue of file handles sent over a socket, which are given to the receiver in the order that they were sent. The
+// handles stay attached to their files whilst queued, so that closing the sender's descriptor doesn't look like the
+// end being closed.
+class HandleQueue : public ustd::Shareable<HandleQueue> {
+    ustd::Vector<FileHandle> m_handles;
+    SpinLock m_lock;
+
+public:
+    HandleQueue() = default;
+    HandleQueue(const HandleQueue &) = delete;
+    HandleQueue(HandleQueue &&) = delete;
+    ~HandleQueue() = default;
+
+    HandleQueue &operator=(const HandleQueue &) = delete;
+    HandleQueue &operator=(HandleQueue &&) = delete;
+
+    ustd::Optional<FileHandle> pop();
+    void push(FileHandle &&handle);
+};
+
+} // namespace kernel
@@ -0,0 +1,29 @@
+#include <kernel/ipc/page_queue.hh>
+
+#include <kernel/mem/vm_object.hh>
+#include <kernel/scoped_lock.hh>
+#include <ustd/shared_ptr.hh>
+#include <ustd/utility.hh>
+#include <ustd/vector.hh>
+
+namespace kernel {
+
+// Defined here since VmObject is incomplete in the header.
+PageQueue::~PageQueue() = default;
+
+ustd::SharedPtr<VmObject> PageQueue::pop() {
+    ScopedLock locker(m_lock);
+    if (m_vm_objects.empty()) {
+        return {};
+    }
+    auto vm_object = ustd::move(m_vm_objects.first());
+    m_vm_objects.remove(0);
+    return vm_object;
+}
+
+void PageQueue::push(ustd::SharedPtr<VmObject> &&vm_object) {
+    ScopedLock locker(m_lock);
+    m_vm_objects.push(ustd::move(vm_object));
+}
+
+} // namespace kernel
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <kernel/spin_lock.hh>
+#include <ustd/shareable.hh>
+#include <ustd/shared_ptr.hh>
+#include <ustd/vector.hh>
+
+namespace kernel {
+
+class VmObject;
+
+// A queue of VM objects sent over a socket, which are mapped into the receiver in the order that they were sent.
+class PageQueue : public ustd::Shareable<PageQueue> {
+    ustd::Vector<ustd::SharedPtr<VmObject>> m_vm_objects;
+    SpinLock m_lock;
+
+public:
+    PageQueue() = default;
+    PageQueue(const PageQueue &) = delete;
+    PageQueue(PageQueue &&) = delete;
+    ~PageQueue();
+
+    PageQueue &operator=(const PageQueue &) = delete;
+    PageQueue &operator=(PageQueue &&) = delete;
+
+    ustd::SharedPtr<VmObject> pop();
+    void push(ustd::SharedPtr<VmObject> &&vm_object);
+};
+
+} // namespace kernel
@@ -1,11 +1,11 @@
 #include <kernel/ipc/pipe.hh>
 
 #include <kernel/fs/file.hh>
-#include <kernel/ipc/double_buffer.hh>
-#include <kernel/scoped_lock.hh>
-#include <kernel/spin_lock.hh>
+#include <kernel/ipc/byte_ring.hh>
+#include <kernel/proc/wait_queue.hh>
 #include <kernel/sys_result.hh>
 #include <ustd/assert.hh>
+#include <ustd/atomic.hh>
 #include <ustd/span.hh>
 #include <ustd/types.hh>
 
@@ -20,29 +20,30 @@ Pipe::Pipe() : m_buffer(k_buffer_size) {}
 
 void Pipe::attach(AttachDirection direction) {
     ASSERT(direction != AttachDirection::ReadWrite);
-    ScopedLock locker(m_lock);
     if (direction == AttachDirection::Read) {
-        m_reader_count++;
+        m_reader_count.fetch_add(1, ustd::memory_order_acq_rel);
     } else if (direction == AttachDirection::Write) {
-        m_writer_count++;
+        m_writer_count.fetch_add(1, ustd::memory_order_acq_rel);
     }
 }
 
 void Pipe::detach(AttachDirection direction) {
     ASSERT(direction != AttachDirection::ReadWrite);
-    ScopedLock locker(m_lock);
     if (direction == AttachDirection::Read) {
-        ASSERT(m_reader_count > 0);
-        m_reader_count--;
+        [[maybe_unused]] const auto reader_count = m_reader_count.fetch_sub(1, ustd::memory_order_acq_rel);
+        ASSERT(reader_count > 0);
     } else if (direction == AttachDirection::Write) {
-        ASSERT(m_writer_count > 0);
-        m_writer_count--;
+        const auto writer_count = m_writer_count.fetch_sub(1, ustd::memory_order_acq_rel);
+        ASSERT(writer_count > 0);
+        if (writer_count == 1) {
+            // Any blocked readers will now see end of file.
+            m_buffer.read_queue().wake_all();
+        }
     }
 }
 
 bool Pipe::read_would_block(size_t) const {
-    ScopedLock locker(m_lock);
-    return m_writer_count != 0 && m_buffer.empty();
+    return m_writer_count.load(ustd::memory_order_acquire) != 0 && m_buffer.empty();
 }
 
 bool Pipe::write_would_block(size_t) const {
@@ -1,19 +1,19 @@
 #pragma once
 
 #include <kernel/fs/file.hh>
-#include <kernel/ipc/double_buffer.hh>
-#include <kernel/spin_lock.hh>
+#include <kernel/ipc/byte_ring.hh>
+#include <kernel/proc/wait_queue.hh>
 #include <kernel/sys_result.hh>
+#include <ustd/atomic.hh>
 #include <ustd/span.hh> // IWYU pragma: keep
 #include <ustd/types.hh>
 
 namespace kernel {
 
 class Pipe final : public File {
-    DoubleBuffer m_buffer;
-    uint32_t m_reader_count{0};
-    uint32_t m_writer_count{0};
-    mutable SpinLock m_lock;
+    ByteRing m_buffer;
+    ustd::Atomic<uint32_t> m_reader_count{0};
+    ustd::Atomic<uint32_t> m_writer_count{0};
 
 public:
     Pipe();
@@ -32,6 +32,8 @@ public:
     bool write_would_block(size_t offset) const override;
     SysResult<size_t> read(ustd::Span<void> data, size_t offset) override;
     SysResult<size_t> write(ustd::Span<const void> data, size_t offset) override;
+    WaitQueue *read_wait_queue() override { return &m_buffer.read_queue(); }
+    WaitQueue *write_wait_queue() override { return &m_buffer.write_queue(); }
 };
 
 } // namespace kernel
@@ -2,6 +2,7 @@
 
 #include <kernel/error.hh>
 #include <kernel/ipc/socket.hh>
+#include <kernel/proc/wait_queue.hh>
 #include <kernel/scoped_lock.hh>
 #include <kernel/spin_lock.hh>
 #include <kernel/sys_result.hh>
@@ -22,7 +23,11 @@ ServerSocket::~ServerSocket() = default;
 ustd::SharedPtr<Socket> ServerSocket::accept() {
     ScopedLock locker(m_lock);
     auto client = m_connection_queue.take(0);
-    return ustd::make_shared<Socket>(client->write_buffer(), client->read_buffer());
+    locker.unlock();
+    auto socket = ustd::make_shared<Socket>(client->write_buffer(), client->read_buffer(), client->write_pages(),
+                                            client->read_pages(), client->write_handles(), client->read_handles());
+    client->connect_queue().wake_all();
+    return socket;
 }
 
 bool ServerSocket::accept_would_block() const {
@@ -44,6 +49,8 @@ SysResult<> ServerSocket::queue_connection_from(ustd::SharedPtr<Socket> socket)
         return Error::Busy;
     }
     m_connection_queue.push(ustd::move(socket));
+    locker.unlock();
+    m_accept_queue.wake_all();
     return {};
 }
 
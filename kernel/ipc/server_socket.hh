@@ -1,6 +1,7 @@
 #pragma once
 
 #include <kernel/fs/file.hh>
+#include <kernel/proc/wait_queue.hh>
 #include <kernel/spin_lock.hh>
 #include <kernel/sys_result.hh>
 #include <ustd/shared_ptr.hh>
@@ -15,6 +16,7 @@ class Socket;
 class ServerSocket final : public File {
     ustd::Vector<ustd::SharedPtr<Socket>> m_connection_queue;
     mutable SpinLock m_lock;
+    WaitQueue m_accept_queue;
 
 public:
     explicit ServerSocket(uint32_t backlog_limit);
@@ -34,6 +36,9 @@ public:
     SysResult<> queue_connection_from(ustd::SharedPtr<Socket> socket);
     SysResult<size_t> read(ustd::Span<void> data, size_t offset) override;
     SysResult<size_t> write(ustd::Span<const void> data, size_t offset) override;
+    WaitQueue *read_wait_queue() override { return &m_accept_queue; }
+
+    WaitQueue &accept_queue() { return m_accept_queue; }
 };
 
 } // namespace kernel
@@ -0,0 +1,21 @@
+#include <kernel/ipc/shared_memory.hh>
+
+#include <kernel/error.hh>
+#include <kernel/mem/vm_object.hh>
+#include <kernel/sys_result.hh>
+#include <ustd/span.hh>
+#include <ustd/types.hh>
+
+namespace kernel {
+
+SharedMemory::SharedMemory(size_t size) : m_vm_object(VmObject::create_lazy(size)) {}
+
+SysResult<size_t> SharedMemory::read(ustd::Span<void>, size_t) {
+    return Error::Invalid;
+}
+
+SysResult<size_t> SharedMemory::write(ustd::Span<const void>, size_t) {
+    return Error::Invalid;
+}
+
+} // namespace kernel
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <kernel/fs/file.hh>
+#include <kernel/mem/vm_object.hh>
+#include <kernel/sys_result.hh>
+#include <ustd/shared_ptr.hh>
+#include <ustd/span.hh> // IWYU pragma: keep
+#include <ustd/types.hh>
+
+namespace kernel {
+
+// Anonymous memory which isn't backed by any inode. Mapping it with UB_MMAP_FLAG_SHARED in several processes, for
+// example after sending it over a socket, gives them all the same pages.
+class SharedMemory final : public File {
+    const ustd::SharedPtr<VmObject> m_vm_object;
+
+public:
+    explicit SharedMemory(size_t size);
+    SharedMemory(const SharedMemory &) = delete;
+    SharedMemory(SharedMemory &&) = delete;
+    ~SharedMemory() override = default;
+
+    SharedMemory &operator=(const SharedMemory &) = delete;
+    SharedMemory &operator=(SharedMemory &&) = delete;
+
+    bool read_would_block(size_t) const override { return false; }
+    bool write_would_block(size_t) const override { return false; }
+    SysResult<size_t> read(ustd::Span<void> data, size_t offset) override;
+    SysResult<size_t> write(ustd::Span<const void> data, size_t offset) override;
+    SysResult<ustd::SharedPtr<VmObject>> vm_object() override { return m_vm_object; }
+};
+
+} // namespace kernel
@@ -1,24 +1,47 @@
 #include <kernel/ipc/socket.hh>
 
-#include <kernel/ipc/double_buffer.hh>
+#include <kernel/ipc/byte_ring.hh>
+#include <kernel/ipc/handle_queue.hh>
+#include <kernel/ipc/page_queue.hh>
+#include <kernel/mem/slab_cache.hh>
+#include <kernel/proc/wait_queue.hh>
 #include <kernel/sys_result.hh>
 #include <ustd/shared_ptr.hh>
 #include <ustd/span.hh>
 #include <ustd/types.hh>
 
 namespace kernel {
+namespace {
 
-Socket::Socket(DoubleBuffer *read_buffer, DoubleBuffer *write_buffer)
-    : m_read_buffer(read_buffer), m_write_buffer(write_buffer) {}
+SlabCache s_slab_cache("socket", sizeof(Socket), alignof(Socket));
 
-Socket::~Socket() = default;
+} // namespace
+
+void *Socket::operator new(size_t size) {
+    return s_slab_cache.allocate(size);
+}
+
+void Socket::operator delete(void *ptr) {
+    s_slab_cache.deallocate(ptr);
+}
+
+Socket::Socket(ByteRing *read_buffer, ByteRing *write_buffer, PageQueue *read_pages, PageQueue *write_pages,
+               HandleQueue *read_handles, HandleQueue *write_handles)
+    : m_read_buffer(read_buffer), m_write_buffer(write_buffer), m_read_pages(read_pages), m_write_pages(write_pages),
+      m_read_handles(read_handles), m_write_handles(write_handles) {}
+
+Socket::~Socket() {
+    // Wake up anything blocked on the other end of the connection.
+    m_read_buffer->close();
+    m_write_buffer->close();
+}
 
 bool Socket::read_would_block(size_t) const {
-    return m_read_buffer->ref_count() == 2 && m_read_buffer->empty();
+    return !m_read_buffer->closed() && m_read_buffer->empty();
 }
 
 bool Socket::write_would_block(size_t) const {
-    return m_write_buffer->ref_count() == 2 && m_write_buffer->full();
+    return !m_write_buffer->closed() && m_write_buffer->full();
 }
 
 SysResult<size_t> Socket::read(ustd::Span<void> data, size_t) {
@@ -29,6 +52,14 @@ SysResult<size_t> Socket::write(ustd::Span<const void> data, size_t) {
     return m_write_buffer->write(data);
 }
 
+WaitQueue *Socket::read_wait_queue() {
+    return &m_read_buffer->read_queue();
+}
+
+WaitQueue *Socket::write_wait_queue() {
+    return &m_write_buffer->write_queue();
+}
+
 bool Socket::connected() const {
     return m_read_buffer->ref_count() == 2;
 }
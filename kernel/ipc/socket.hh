@@ -1,6 +1,7 @@
 #pragma once
 
 #include <kernel/fs/file.hh>
+#include <kernel/proc/wait_queue.hh>
 #include <kernel/sys_result.hh>
 #include <ustd/shared_ptr.hh>
 #include <ustd/span.hh> // IWYU pragma: keep
@@ -8,14 +9,22 @@
 
 namespace kernel {
 
-class DoubleBuffer;
+class ByteRing;
+class HandleQueue;
+class PageQueue;
 
 class Socket final : public File {
-    ustd::SharedPtr<DoubleBuffer> m_read_buffer;
-    ustd::SharedPtr<DoubleBuffer> m_write_buffer;
+    ustd::SharedPtr<ByteRing> m_read_buffer;
+    ustd::SharedPtr<ByteRing> m_write_buffer;
+    ustd::SharedPtr<PageQueue> m_read_pages;
+    ustd::SharedPtr<PageQueue> m_write_pages;
+    ustd::SharedPtr<HandleQueue> m_read_handles;
+    ustd::SharedPtr<HandleQueue> m_write_handles;
+    WaitQueue m_connect_queue;
 
 public:
-    Socket(DoubleBuffer *read_buffer, DoubleBuffer *write_buffer);
+    Socket(ByteRing *read_buffer, ByteRing *write_buffer, PageQueue *read_pages, PageQueue *write_pages,
+           HandleQueue *read_handles, HandleQueue *write_handles);
     Socket(const Socket &) = delete;
     Socket(Socket &&) = delete;
     ~Socket() override;
@@ -23,16 +32,26 @@ public:
     Socket &operator=(const Socket &) = delete;
     Socket &operator=(Socket &&) = delete;
 
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
+
     bool is_socket() const override { return true; }
 
     bool read_would_block(size_t offset) const override;
     bool write_would_block(size_t offset) const override;
     SysResult<size_t> read(ustd::Span<void> data, size_t offset) override;
     SysResult<size_t> write(ustd::Span<const void> data, size_t offset) override;
+    WaitQueue *read_wait_queue() override;
+    WaitQueue *write_wait_queue() override;
 
     bool connected() const;
-    DoubleBuffer *read_buffer() const { return m_read_buffer.ptr(); }
-    DoubleBuffer *write_buffer() const { return m_write_buffer.ptr(); }
+    WaitQueue &connect_queue() { return m_connect_queue; }
+    ByteRing *read_buffer() const { return m_read_buffer.ptr(); }
+    ByteRing *write_buffer() const { return m_write_buffer.ptr(); }
+    PageQueue *read_pages() const { return m_read_pages.ptr(); }
+    PageQueue *write_pages() const { return m_write_pages.ptr(); }
+    HandleQueue *read_handles() const { return m_read_handles.ptr(); }
+    HandleQueue *write_handles() const { return m_write_handles.ptr(); }
 };
 
 } // namespace kernel
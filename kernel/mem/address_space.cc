@@ -2,12 +2,18 @@
 
 #include <kernel/dmesg.hh>
 #include <kernel/error.hh>
+#include <kernel/mem/memory_manager.hh>
 #include <kernel/mem/region.hh>
 #include <kernel/mem/vm_object.hh>
 #include <kernel/proc/process.hh>
 #include <kernel/scoped_lock.hh>
 #include <ustd/assert.hh>
+#include <ustd/numeric.hh>
+#include <ustd/optional.hh>
+#include <ustd/shared_ptr.hh>
 #include <ustd/try.hh>
+#include <ustd/unique_ptr.hh>
+#include <ustd/vector.hh>
 
 namespace kernel {
 namespace {
@@ -15,33 +21,85 @@ namespace {
 // TODO: Arch specific.
 constexpr size_t k_total_size = 1ull << 48u;
 
+// Returns the lowest aligned base at which size bytes fit either in the gap between previous_end and the first region of
+// the given subtree, or in a gap within the subtree. Subtrees whose largest gap is too small are skipped entirely.
+ustd::Optional<uintptr_t> find_gap(Region *region, uintptr_t previous_end, size_t size, size_t alignment) {
+    if (region == nullptr) {
+        return {};
+    }
+    const size_t leading_gap = region->subtree_base() > previous_end ? region->subtree_base() - previous_end : 0;
+    if (leading_gap < size && region->subtree_max_gap() < size) {
+        return {};
+    }
+    if (auto base = find_gap(region->left_node(), previous_end, size, alignment)) {
+        return base;
+    }
+    const auto *left = region->left_node();
+    const uintptr_t base = ustd::align_up(left != nullptr ? left->subtree_end() : previous_end, alignment);
+    if (base <= region->base() && region->base() - base >= size) {
+        return base;
+    }
+    return find_gap(region->right_node(), region->range().end(), size, alignment);
+}
+
 } // namespace
 
 AddressSpace::AddressSpace(Process &process) : m_process(process), m_pml4(new Pml4) {}
 
 AddressSpace::~AddressSpace() {
-    m_regions.clear();
-    ASSERT(m_region_tree.root_node() == nullptr);
+    ScopedLock lock(m_lock);
+    while (auto *region = m_region_tree.root_node()) {
+        auto vm_object = remove_region(region, region->range());
+        lock.unlock();
+        vm_object.clear();
+        lock.relock(m_lock);
+    }
 }
 
-void AddressSpace::detree_region(Region *region) {
-    ScopedLock lock(m_lock);
-    m_region_tree.remove(region);
+Region *AddressSpace::find_region(uintptr_t virt) {
+    ASSERT(m_lock.is_locked_by_current_cpu());
+    auto *region = m_region_tree.find_floor(virt);
+    return region != nullptr && virt < region->range().end() ? region : nullptr;
 }
 
-void AddressSpace::map_4KiB(uintptr_t virt, uintptr_t phys, PageFlags flags) {
-    ASSERT(virt % 4_KiB == 0);
-    ASSERT(phys % 4_KiB == 0);
+PageTable &AddressSpace::ensure_page_table(uintptr_t virt) {
+    ASSERT(m_lock.is_locked_by_current_cpu());
     const size_t pml4_index = (virt >> 39ul) & 0x1fful;
     const size_t pdpt_index = (virt >> 30ul) & 0x1fful;
     const size_t pd_index = (virt >> 21ul) & 0x1fful;
-    const size_t pt_index = (virt >> 12ul) & 0x1fful;
-
-    ScopedLock lock(m_lock);
     auto *pdpt = m_pml4->ensure(pml4_index);
     auto *pd = pdpt->ensure(pdpt_index);
-    auto *pt = pd->ensure(pd_index);
-    pt->set(pt_index, phys, flags);
+    return *pd->ensure(pd_index);
+}
+
+bool AddressSpace::is_mapped_4KiB(uintptr_t virt) {
+    const size_t pml4_index = (virt >> 39ul) & 0x1fful;
+    const size_t pdpt_index = (virt >> 30ul) & 0x1fful;
+    const size_t pd_index = (virt >> 21ul) & 0x1fful;
+    const size_t pt_index = (virt >> 12ul) & 0x1fful;
+
+    ASSERT(m_lock.is_locked_by_current_cpu());
+    if (m_pml4->entries()[pml4_index].empty()) {
+        return false;
+    }
+    auto *pdpt = m_pml4->expect(pml4_index);
+    if (pdpt->entries()[pdpt_index].empty()) {
+        return false;
+    }
+    auto *pd = pdpt->expect(pdpt_index);
+    if (pd->entries()[pd_index].empty()) {
+        return false;
+    }
+    return !pd->expect(pd_index)->entries()[pt_index].empty();
+}
+
+void AddressSpace::map_4KiB(uintptr_t virt, uintptr_t phys, PageFlags flags) {
+    ASSERT(virt % 4_KiB == 0);
+    ASSERT(phys % 4_KiB == 0);
+    const size_t pt_index = (virt >> 12ul) & 0x1fful;
+
+    ASSERT(m_lock.is_locked_by_current_cpu());
+    ensure_page_table(virt).set(pt_index, phys, flags);
 }
 
 void AddressSpace::map_2MiB(uintptr_t virt, uintptr_t phys, PageFlags flags) {
@@ -51,7 +109,7 @@ void AddressSpace::map_2MiB(uintptr_t virt, uintptr_t phys, PageFlags flags) {
     const size_t pdpt_index = (virt >> 30ul) & 0x1fful;
     const size_t pd_index = (virt >> 21ul) & 0x1fful;
 
-    ScopedLock lock(m_lock);
+    ASSERT(m_lock.is_locked_by_current_cpu());
     auto *pdpt = m_pml4->ensure(pml4_index);
     auto *pd = pdpt->ensure(pdpt_index);
     pd->set(pd_index, phys, flags | PageFlags::Large);
@@ -63,7 +121,7 @@ void AddressSpace::map_1GiB(uintptr_t virt, uintptr_t phys, PageFlags flags) {
     const size_t pml4_index = (virt >> 39ul) & 0x1fful;
     const size_t pdpt_index = (virt >> 30ul) & 0x1fful;
 
-    ScopedLock lock(m_lock);
+    ASSERT(m_lock.is_locked_by_current_cpu());
     auto *pdpt = m_pml4->ensure(pml4_index);
     pdpt->set(pdpt_index, phys, flags | PageFlags::Large);
 }
@@ -75,7 +133,7 @@ void AddressSpace::unmap_4KiB(uintptr_t virt) {
     const size_t pd_index = (virt >> 21ul) & 0x1fful;
     const size_t pt_index = (virt >> 12ul) & 0x1fful;
 
-    ScopedLock lock(m_lock);
+    ASSERT(m_lock.is_locked_by_current_cpu());
     auto *pdpt = m_pml4->expect(pml4_index);
     auto *pd = pdpt->expect(pdpt_index);
     auto *pt = pd->expect(pd_index);
@@ -97,7 +155,7 @@ void AddressSpace::unmap_2MiB(uintptr_t virt) {
     const size_t pdpt_index = (virt >> 30ul) & 0x1fful;
     const size_t pd_index = (virt >> 21ul) & 0x1fful;
 
-    ScopedLock lock(m_lock);
+    ASSERT(m_lock.is_locked_by_current_cpu());
     auto *pdpt = m_pml4->expect(pml4_index);
     auto *pd = pdpt->expect(pdpt_index);
     pd->unset(pd_index);
@@ -114,7 +172,7 @@ void AddressSpace::unmap_1GiB(uintptr_t virt) {
     const size_t pml4_index = (virt >> 39ul) & 0x1fful;
     const size_t pdpt_index = (virt >> 30ul) & 0x1fful;
 
-    ScopedLock lock(m_lock);
+    ASSERT(m_lock.is_locked_by_current_cpu());
     auto *pdpt = m_pml4->expect(pml4_index);
     pdpt->unset(pdpt_index);
     if (pdpt->entry_count() == 0u) {
@@ -122,25 +180,97 @@ void AddressSpace::unmap_1GiB(uintptr_t virt) {
     }
 }
 
-SysResult<VirtualRange> AddressSpace::allocate_range_anywhere(size_t size) {
-    ASSERT(size % 4_KiB == 0);
-    const auto alignment = size >= 1_GiB ? 1_GiB : size >= 2_MiB ? 2_MiB : 4_KiB;
+// Removes the given range from any regions overlapping it, splitting them where needed. The removed parts are then
+// remapped with the given access, or freed if there is none. The old VM objects are handed back in old_vm_objects, so
+// that the caller can release them, which may free their pages, after dropping the lock.
+SysResult<> AddressSpace::carve(VirtualRange range, ustd::Optional<RegionAccess> access,
+                                ustd::Vector<ustd::SharedPtr<VmObject>> &old_vm_objects) {
+    ASSERT(m_lock.is_locked_by_current_cpu());
+    if (range.base() % 4_KiB != 0 || range.size() == 0) {
+        return Error::Invalid;
+    }
+    range = {range.base(), ustd::align_up(range.size(), 4_KiB)};
+    if (range.end() < range.base() || range.end() > k_total_size) {
+        return Error::Invalid;
+    }
 
-    uintptr_t previous_region_end = alignment;
-    for (auto *region = m_region_tree.minimum_node(); region != nullptr; region = RegionTree::successor(region)) {
-        if (region->base() > previous_region_end) {
-            VirtualRange available_range(previous_region_end, region->base() - previous_region_end);
-            if (available_range.size() >= size && available_range.end() < k_total_size) {
-                return VirtualRange(available_range.base(), size);
+    auto *first = m_region_tree.find_floor(range.base());
+    if (first == nullptr || first->range().end() <= range.base()) {
+        first = first != nullptr ? RegionTree::successor(first) : m_region_tree.minimum_node();
+    }
+
+    // Check that every overlapping region can be carved up before changing anything. Only lazy VM objects can be
+    // mapped at an offset, so regions backed by anything else can only be changed as a whole. Access can't be raised
+    // above what the region was mapped with, so that, for example, a read only shared mapping of a file can't be used
+    // to write to the file's pages.
+    for (auto *region = first; region != nullptr && region->base() < range.end();
+         region = RegionTree::successor(region)) {
+        if ((region->access() & RegionAccess::UserAccessible) != RegionAccess::UserAccessible) {
+            return Error::Invalid;
+        }
+        const bool whole = range.base() <= region->base() && range.end() >= region->range().end();
+        if (!whole && region->m_vm_object && !region->m_vm_object->is_lazy()) {
+            return Error::Invalid;
+        }
+        if (access && (*access & ~region->max_access()) != RegionAccess::None) {
+            return Error::Invalid;
+        }
+    }
+
+    // Replace each region with its remaining parts without dropping the lock, so that no other thread can see or claim
+    // the range whilst it is only partly carved. The parts are split off in place, so the next region is unaffected.
+    for (auto *region = first; region != nullptr && region->base() < range.end();) {
+        auto *next = RegionTree::successor(region);
+        const auto old_range = region->range();
+        const auto old_access = region->access();
+        const auto old_max_access = region->max_access();
+        const size_t vm_object_offset = region->m_vm_object_offset;
+        const bool shared = region->m_shared;
+        const uintptr_t carve_base = ustd::max(range.base(), old_range.base());
+        const uintptr_t carve_end = ustd::min(range.end(), old_range.end());
+
+        // Only the carved part is unmapped. The remaining parts map the same pages with the same access, so anything
+        // already faulted in outside of it stays mapped for them.
+        auto vm_object = remove_region(region, {carve_base, carve_end - carve_base});
+        if (!access && vm_object && vm_object->is_lazy() && !shared) {
+            const size_t first_index = (vm_object_offset + carve_base - old_range.base()) / 4_KiB;
+            vm_object->decommit(first_index, (carve_end - carve_base) / 4_KiB);
+        }
+
+        auto remap = [&](uintptr_t base, uintptr_t end, RegionAccess piece_access) {
+            if (base == end) {
+                return;
+            }
+            auto &piece = new_region({base, end - base}, piece_access);
+            piece.m_max_access = old_max_access;
+            if (vm_object) {
+                const size_t offset = vm_object_offset + (base - old_range.base());
+                piece.map_locked(ustd::SharedPtr<VmObject>(vm_object), offset, shared);
             }
+        };
+        remap(old_range.base(), carve_base, old_access);
+        if (access) {
+            remap(carve_base, carve_end, *access);
         }
+        remap(carve_end, old_range.end(), old_access);
+        old_vm_objects.push(ustd::move(vm_object));
+        region = next;
+    }
+    return {};
+}
+
+SysResult<VirtualRange> AddressSpace::allocate_range_anywhere(size_t size) {
+    ASSERT(size % 4_KiB == 0);
+    const auto alignment = size >= 1_GiB ? 1_GiB : size >= 2_MiB ? 2_MiB : 4_KiB;
 
-        // TODO: Should check for overflow.
-        previous_region_end = ustd::align_up(region->range().end(), alignment);
+    auto *root = m_region_tree.root_node();
+    if (auto base = find_gap(root, alignment, size, alignment)) {
+        return VirtualRange(*base, size);
     }
 
     // No suitable gaps, but there is likely still a large gap after the last region covering the rest of unallocated
     // address space.
+    const uintptr_t previous_region_end = ustd::align_up(root != nullptr ? root->subtree_end() : alignment, alignment);
     if (previous_region_end < k_total_size) {
         const auto available_size = k_total_size - previous_region_end;
         if (available_size >= size) {
@@ -153,17 +283,32 @@ SysResult<VirtualRange> AddressSpace::allocate_range_anywhere(size_t size) {
 }
 
 SysResult<VirtualRange> AddressSpace::allocate_range_specific(VirtualRange range) {
-    if (m_region_tree.find_no_splay(range.base()) != nullptr) {
-        // TODO
+    if (range.base() % 4_KiB != 0 || range.size() % 4_KiB != 0 || range.end() < range.base() ||
+        range.end() > k_total_size) {
+        return Error::Invalid;
+    }
+    // Regions don't overlap, so only the last region starting before the end of the range can overlap it.
+    auto *region = m_region_tree.find_floor(range.end() - 1);
+    if (region != nullptr && region->range().end() > range.base()) {
+        return Error::AlreadyExists;
     }
-    // TODO: Check size.
     return range;
 }
 
 Region &AddressSpace::new_region(VirtualRange range, RegionAccess access) {
-    auto &region = *m_regions.emplace(new Region(*this, range, access));
-    m_region_tree.insert(&region);
-    return region;
+    auto *region = new Region(*this, range, access);
+    m_region_tree.insert(region);
+    return *region;
+}
+
+// Removes the region from the tree, unmaps the given part of it and destroys it, handing back its VM object so that the
+// caller can release it after dropping the lock.
+ustd::SharedPtr<VmObject> AddressSpace::remove_region(Region *region, VirtualRange unmap_range) {
+    ASSERT(m_lock.is_locked_by_current_cpu());
+    m_region_tree.remove(region);
+    auto vm_object = region->unmap(unmap_range);
+    delete region;
+    return vm_object;
 }
 
 SysResult<Region &> AddressSpace::allocate_anywhere(size_t size, RegionAccess access) {
@@ -178,45 +323,87 @@ SysResult<Region &> AddressSpace::allocate_specific(VirtualRange range, RegionAc
     return new_region(range, access);
 }
 
-SysResult<uintptr_t> AddressSpace::virt_to_phys(uintptr_t virt) {
-    // TODO(rb-tree): This sucks.
+SysResult<> AddressSpace::free(VirtualRange range) {
+    // Declared before the lock so that the old VM objects are released after it has been dropped.
+    ustd::Vector<ustd::SharedPtr<VmObject>> old_vm_objects;
     ScopedLock lock(m_lock);
-    for (auto *region = m_region_tree.minimum_node(); region != nullptr; region = RegionTree::successor(region)) {
-        if (virt < region->base() || virt >= region->range().end()) {
-            continue;
+    return carve(range, {}, old_vm_objects);
+}
+
+SysResult<> AddressSpace::protect(VirtualRange range, RegionAccess access) {
+    ustd::Vector<ustd::SharedPtr<VmObject>> old_vm_objects;
+    ScopedLock lock(m_lock);
+    return carve(range, access, old_vm_objects);
+}
+
+bool AddressSpace::handle_fault(uintptr_t virt, RegionAccess required_access) {
+    ScopedLock lock(m_lock);
+    auto *region = find_region(virt);
+    if (region == nullptr || (region->access() & required_access) != required_access) {
+        return false;
+    }
+    const bool write = (required_access & RegionAccess::Writable) == RegionAccess::Writable;
+    return region->commit_page(virt, write).has_value();
+}
+
+// Moves the pages backing the given range into a new VM object and frees the range, so that the pages can be mapped
+// elsewhere without copying. The range must lie within a single writable region backed by a private lazy VM object.
+SysResult<ustd::SharedPtr<VmObject>> AddressSpace::take(VirtualRange range) {
+    if (range.base() % 4_KiB != 0 || range.size() % 4_KiB != 0 || range.size() == 0 || range.end() < range.base()) {
+        return Error::Invalid;
+    }
+
+    ustd::Vector<ustd::SharedPtr<VmObject>> old_vm_objects;
+    ScopedLock lock(m_lock);
+    auto *region = find_region(range.base());
+    const auto required_access = RegionAccess::Writable | RegionAccess::UserAccessible;
+    if (region == nullptr || range.end() > region->range().end() ||
+        (region->access() & required_access) != required_access) {
+        return Error::Invalid;
+    }
+    const auto vm_object = region->vm_object();
+    const size_t offset = region->m_vm_object_offset + (range.base() - region->base());
+    if (!vm_object || !vm_object->is_lazy() || region->m_shared || offset + range.size() > vm_object->size()) {
+        return Error::Invalid;
+    }
+
+    // Unmap the range by splitting it off into a region of its own with the same access, which keeps the pages in the
+    // VM object. Only once nothing maps them any more are the pages moved out, and the now empty range freed, all
+    // without dropping the lock so that a racing fault can't map the range again in between.
+    TRY(carve(range, region->access(), old_vm_objects));
+    auto pages = vm_object->take_pages(offset / 4_KiB, range.size() / 4_KiB);
+    ASSUME(carve(range, {}, old_vm_objects), "Failed to free a range split off by take");
+    return pages;
+}
+
+// If a pin is given, the frame is pinned before the lock is dropped, since the region could be freed straight after.
+SysResult<uintptr_t> AddressSpace::virt_to_phys(uintptr_t virt, FramePin *pin) {
+    ScopedLock lock(m_lock);
+    auto *region = find_region(virt);
+    if (region == nullptr || !region->m_vm_object) {
+        return Error::NonExistent;
+    }
+
+    // Make sure lazily backed memory is actually backed, since the physical address is likely going to be used for DMA.
+    const auto &vm_object = region->m_vm_object;
+    uintptr_t phys = 0;
+    if (vm_object->is_lazy()) {
+        auto page = region->commit_page(virt, true);
+        if (!page) {
+            return Error::NonExistent;
         }
-        for (uintptr_t page_virt = region->base(); const auto &physical_page : region->vm_object()->physical_pages()) {
-            uintptr_t page_end = page_virt;
-            switch (physical_page.size()) {
-            case PhysicalPageSize::Normal:
-                page_end += 4_KiB;
-                break;
-            case PhysicalPageSize::Large:
-                page_end += 2_MiB;
-                break;
-            case PhysicalPageSize::Huge:
-                page_end += 1_GiB;
-                break;
-            }
-            if (virt < page_virt || virt >= page_end) {
-                continue;
-            }
-            size_t offset = virt - page_virt;
-            switch (physical_page.size()) {
-            case PhysicalPageSize::Normal:
-                page_virt += 4_KiB;
-                break;
-            case PhysicalPageSize::Large:
-                page_virt += 2_MiB;
-                break;
-            case PhysicalPageSize::Huge:
-                page_virt += 1_GiB;
-                break;
-            }
-            return physical_page.phys() + offset;
+        phys = *page + (virt & 0xfffu);
+    } else {
+        const size_t offset = region->m_vm_object_offset + (virt - region->base());
+        if (offset >= vm_object->size()) {
+            return Error::NonExistent;
         }
+        phys = vm_object->phys_at(offset);
+    }
+    if (pin != nullptr) {
+        MemoryManager::pin_frame(*pin, phys);
     }
-    return Error::NonExistent;
+    return phys;
 }
 
 } // namespace kernel
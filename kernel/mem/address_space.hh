@@ -4,16 +4,19 @@
 #include <kernel/mem/region.hh>
 #include <kernel/spin_lock.hh>
 #include <kernel/sys_result.hh>
+#include <ustd/optional.hh>
 #include <ustd/rb_tree.hh>
-#include <ustd/splay_tree.hh>
+#include <ustd/shared_ptr.hh>
 #include <ustd/unique_ptr.hh>
 #include <ustd/vector.hh>
 
 namespace kernel {
 
 class Process;
+class VmObject;
+struct FramePin;
 
-using RegionTree = ustd::SplayTree<uintptr_t, Region, &Region::base>;
+using RegionTree = ustd::RedBlackTree<uintptr_t, Region, &Region::base>;
 
 class AddressSpace {
     friend Region;
@@ -21,13 +24,13 @@ class AddressSpace {
 private:
     Process &m_process;
     ustd::UniquePtr<Pml4> m_pml4;
+    // Owns the regions, which are only destroyed by remove_region.
     RegionTree m_region_tree;
     mutable SpinLock m_lock;
 
-    // TODO: This storage is only temporary as regions will become shared objects.
-    ustd::Vector<ustd::UniquePtr<Region>> m_regions;
-
-    void detree_region(Region *region);
+    Region *find_region(uintptr_t virt);
+    PageTable &ensure_page_table(uintptr_t virt);
+    bool is_mapped_4KiB(uintptr_t virt);
     void map_4KiB(uintptr_t virt, uintptr_t phys, PageFlags flags);
     void map_2MiB(uintptr_t virt, uintptr_t phys, PageFlags flags);
     void map_1GiB(uintptr_t virt, uintptr_t phys, PageFlags flags);
@@ -35,9 +38,12 @@ private:
     void unmap_2MiB(uintptr_t virt);
     void unmap_1GiB(uintptr_t virt);
 
+    SysResult<> carve(VirtualRange range, ustd::Optional<RegionAccess> access,
+                      ustd::Vector<ustd::SharedPtr<VmObject>> &old_vm_objects);
     SysResult<VirtualRange> allocate_range_anywhere(size_t size);
     SysResult<VirtualRange> allocate_range_specific(VirtualRange range);
     Region &new_region(VirtualRange range, RegionAccess access);
+    ustd::SharedPtr<VmObject> remove_region(Region *region, VirtualRange unmap_range);
 
 public:
     explicit AddressSpace(Process &process);
@@ -50,7 +56,11 @@ public:
 
     SysResult<Region &> allocate_anywhere(size_t size, RegionAccess access);
     SysResult<Region &> allocate_specific(VirtualRange range, RegionAccess access);
-    SysResult<uintptr_t> virt_to_phys(uintptr_t virt);
+    SysResult<> free(VirtualRange range);
+    SysResult<> protect(VirtualRange range, RegionAccess access);
+    bool handle_fault(uintptr_t virt, RegionAccess required_access);
+    SysResult<ustd::SharedPtr<VmObject>> take(VirtualRange range);
+    SysResult<uintptr_t> virt_to_phys(uintptr_t virt, FramePin *pin = nullptr);
 
     Process &process() const { return m_process; }
     void *pml4_ptr() const { return m_pml4.ptr(); }
@@ -1,5 +1,6 @@
 #include <kernel/mem/heap.hh>
 
+#include <kernel/arch/cpu.hh>
 #include <kernel/mem/memory_manager.hh>
 #include <kernel/scoped_lock.hh>
 #include <kernel/spin_lock.hh>
@@ -15,6 +16,7 @@ namespace {
 constexpr size_t k_allocation_header_check = 0xdeadbeef;
 constexpr size_t k_bucket_bit_count = sizeof(size_t) * 8;
 constexpr size_t k_chunk_size = 32;
+constexpr uint32_t k_magazine_batch_size = k_heap_magazine_capacity / 2;
 
 struct AllocationHeader {
     size_t check;
@@ -184,8 +186,85 @@ void deallocate(void *ptr) {
     }
 }
 
+size_t chunk_count_for(size_t size) {
+    return ustd::ceil_div(size + sizeof(AllocationHeader), k_chunk_size);
+}
+
+// Size classes are power of two chunk counts, from a single chunk (size class 0) up to 16 chunks (size class 4).
+uint32_t size_class_for(size_t chunk_count) {
+    if (chunk_count <= 1) {
+        return 0;
+    }
+    return static_cast<uint32_t>(sizeof(size_t) * 8 - ustd::clz(chunk_count - 1));
+}
+
+// Note that we don't need to worry about being preempted whilst accessing the per-CPU cache since interrupts are always
+// disabled in ring 0.
+void *cached_allocate(size_t size) {
+    auto *cache = arch::heap_cache();
+    const auto size_class = size_class_for(chunk_count_for(size));
+    if (cache == nullptr || size_class >= k_heap_size_class_count) {
+        ScopedLock locker(s_lock);
+        return allocate(size);
+    }
+
+    ScopedLock cache_locker(cache->lock);
+    auto &magazine = cache->magazines[size_class];
+    if (magazine.count == 0) {
+        // Refill half of the magazine at once to amortise the cost of taking the global lock.
+        const size_t class_size = (k_chunk_size << size_class) - sizeof(AllocationHeader);
+        ScopedLock locker(s_lock);
+        while (magazine.count < k_magazine_batch_size) {
+            magazine.slots[magazine.count++] = allocate(class_size);
+        }
+    }
+    return magazine.slots[--magazine.count];
+}
+
+void cached_deallocate(void *ptr) {
+    auto *header = &reinterpret_cast<AllocationHeader *>(ptr)[-1];
+    ASSERT(header->check == k_allocation_header_check);
+    auto *cache = arch::heap_cache();
+    const auto size_class = size_class_for(header->chunk_count);
+    if (cache == nullptr || size_class >= k_heap_size_class_count ||
+        header->chunk_count != (static_cast<size_t>(1) << size_class)) {
+        ScopedLock locker(s_lock);
+        deallocate(ptr);
+        return;
+    }
+
+    ScopedLock cache_locker(cache->lock);
+    auto &magazine = cache->magazines[size_class];
+    if (magazine.count == k_heap_magazine_capacity) {
+        // Drain half of the magazine back to the regions, leaving room for subsequent frees.
+        ScopedLock locker(s_lock);
+        while (magazine.count > k_heap_magazine_capacity - k_magazine_batch_size) {
+            deallocate(magazine.slots[--magazine.count]);
+        }
+    }
+    magazine.slots[magazine.count++] = ptr;
+}
+
 } // namespace
 
+// Returns every allocation held in any CPU's magazines to the heap regions, so that regions left empty can be freed.
+// Does nothing if called from within the heap, such as when creating a region runs out of memory.
+void Heap::drain_caches() {
+    if (s_lock.is_locked_by_current_cpu()) {
+        return;
+    }
+    for (uint32_t cpu = 0; cpu < arch::cpu_count(); cpu++) {
+        auto *cache = arch::heap_cache(cpu);
+        ScopedLock cache_locker(cache->lock);
+        ScopedLock locker(s_lock);
+        for (auto &magazine : cache->magazines) {
+            while (magazine.count != 0) {
+                deallocate(magazine.slots[--magazine.count]);
+            }
+        }
+    }
+}
+
 void Heap::initialise() {
     ASSERT(s_base_region == nullptr);
     constexpr size_t aligned_size = ustd::align_up(sizeof(Region), 16);
@@ -194,8 +273,7 @@ void Heap::initialise() {
 }
 
 void *operator new(size_t size) {
-    ScopedLock locker(s_lock);
-    return allocate(size);
+    return cached_allocate(size);
 }
 
 void *operator new[](size_t size) {
@@ -205,8 +283,7 @@ void *operator new[](size_t size) {
 void *operator new(size_t size, ustd::align_val_t align) {
     const auto alignment = static_cast<size_t>(align);
     ASSERT(alignment != 0);
-    ScopedLock locker(s_lock);
-    void *ptr = allocate(size + alignment + sizeof(ptrdiff_t));
+    void *ptr = cached_allocate(size + alignment + sizeof(ptrdiff_t));
     size_t max_addr = reinterpret_cast<size_t>(ptr) + alignment;
     void *aligned_ptr = reinterpret_cast<void *>(max_addr - (max_addr % alignment));
     (reinterpret_cast<ptrdiff_t *>(aligned_ptr))[-1] =
@@ -222,8 +299,7 @@ void operator delete(void *ptr) {
     if (ptr == nullptr) {
         return;
     }
-    ScopedLock locker(s_lock);
-    deallocate(ptr);
+    cached_deallocate(ptr);
 }
 
 void operator delete[](void *ptr) {
@@ -234,8 +310,7 @@ void operator delete(void *ptr, ustd::align_val_t) {
     if (ptr == nullptr) {
         return;
     }
-    ScopedLock locker(s_lock);
-    deallocate(reinterpret_cast<uint8_t *>(ptr) - (reinterpret_cast<const ptrdiff_t *>(ptr))[-1]);
+    cached_deallocate(reinterpret_cast<uint8_t *>(ptr) - (reinterpret_cast<const ptrdiff_t *>(ptr))[-1]);
 }
 
 void operator delete[](void *ptr, ustd::align_val_t align) {
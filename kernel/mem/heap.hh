@@ -1,8 +1,29 @@
 #pragma once
 
+#include <kernel/spin_lock.hh>
+#include <ustd/array.hh>
+#include <ustd/types.hh>
+
 namespace kernel {
 
+constexpr uint32_t k_heap_magazine_capacity = 32;
+constexpr uint32_t k_heap_size_class_count = 5;
+
+struct HeapMagazine {
+    ustd::Array<void *, k_heap_magazine_capacity> slots;
+    uint32_t count{0};
+};
+
+// A per-CPU cache of free small allocations, with one magazine per size class. It is stored in the CPU local storage
+// and is refilled from and drained to the shared heap regions in batches, so that most allocations and deallocations
+// don't need to take the global heap lock. The lock is only contended when another CPU drains the cache.
+struct HeapCache {
+    ustd::Array<HeapMagazine, k_heap_size_class_count> magazines{};
+    SpinLock lock;
+};
+
 struct Heap {
+    static void drain_caches();
     static void initialise();
 };
 
@@ -1,6 +1,7 @@
 #include <kernel/mem/memory_manager.hh>
 
 #include <boot/boot_info.hh>
+#include <kernel/arch/cpu.hh>
 #include <kernel/dmesg.hh>
 #include <kernel/mem/address_space.hh>
 #include <kernel/mem/heap.hh>
@@ -9,7 +10,9 @@
 #include <kernel/mem/vm_object.hh>
 #include <kernel/scoped_lock.hh>
 #include <kernel/spin_lock.hh>
+#include <ustd/array.hh>
 #include <ustd/assert.hh>
+#include <ustd/atomic.hh>
 #include <ustd/numeric.hh>
 #include <ustd/optional.hh>
 #include <ustd/splay_tree.hh>
@@ -20,42 +23,194 @@
 namespace kernel {
 namespace {
 
-constexpr size_t k_bucket_bit_count = sizeof(size_t) * 8;
+// Frames are managed by a binary buddy allocator, with one free list per order. An order n block is 2^n frames large
+// and is naturally aligned to its size, which means the largest order allocates 1 GiB frames.
 constexpr size_t k_frame_size = 4_KiB;
+constexpr uint8_t k_max_order = 18;
+constexpr uint8_t k_not_free = 0xff;
+
+struct FreeBlock {
+    FreeBlock *prev;
+    FreeBlock *next;
+};
 
 struct MemoryManagerData {
-    size_t *frame_bitset{nullptr};
+    // The order of each free block, stored at the index of the block's first frame. All other frames are k_not_free.
+    uint8_t *frame_orders{nullptr};
     size_t frame_count{0};
+    ustd::Array<FreeBlock *, k_max_order + 1> free_lists{};
+    size_t free_frame_count{0};
     VmObject *kernel_object{nullptr};
 } s_data;
 SpinLock s_lock;
 
+// The pins held on frames, linked through the pins themselves and guarded by s_lock. The number of pins is also kept
+// per hash of the frame, so that frees of frames which can't be pinned don't need to look at the list.
+FramePin *s_pins = nullptr;
+ustd::Array<ustd::Atomic<uint32_t>, 64> s_pin_counts;
+
 ustd::Optional<uintptr_t> find_first_fit_region(BootInfo *boot_info, size_t size) {
+    // Only consider available memory, reclaimable memory gets freed later on.
     const size_t page_count = ustd::align_up(size, k_frame_size) / k_frame_size;
     for (size_t i = boot_info->map_entry_count; i > 0; i--) {
-        auto &entry = boot_info->map[i];
-        if (entry.type != MemoryType::Reserved && entry.page_count >= page_count) {
+        auto &entry = boot_info->map[i - 1];
+        if (entry.type == MemoryType::Available && entry.base != 0 && entry.page_count >= page_count) {
             return entry.base;
         }
     }
     return {};
 }
 
-size_t &frame_bitset_bucket(size_t index) {
-    ASSERT(index < s_data.frame_count);
-    return s_data.frame_bitset[(index + k_bucket_bit_count) / k_bucket_bit_count];
+FreeBlock *block_at(size_t index) {
+    return reinterpret_cast<FreeBlock *>(index * k_frame_size);
+}
+
+size_t index_of(FreeBlock *block) {
+    return reinterpret_cast<uintptr_t>(block) / k_frame_size;
+}
+
+void push_block(size_t index, uint8_t order) {
+    auto *block = block_at(index);
+    auto *&head = s_data.free_lists[order];
+    block->prev = nullptr;
+    block->next = head;
+    if (head != nullptr) {
+        head->prev = block;
+    }
+    head = block;
+    s_data.frame_orders[index] = order;
+    s_data.free_frame_count += 1ul << order;
+}
+
+void remove_block(size_t index) {
+    auto *block = block_at(index);
+    const auto order = s_data.frame_orders[index];
+    ASSERT(order != k_not_free);
+    if (block->prev != nullptr) {
+        block->prev->next = block->next;
+    } else {
+        s_data.free_lists[order] = block->next;
+    }
+    if (block->next != nullptr) {
+        block->next->prev = block->prev;
+    }
+    s_data.frame_orders[index] = k_not_free;
+    s_data.free_frame_count -= 1ul << order;
+}
+
+// Returns the index of the free block containing the given frame, if any.
+ustd::Optional<size_t> containing_block(size_t index) {
+    for (uint8_t order = 0; order <= k_max_order; order++) {
+        const auto head = ustd::align_down(index, 1ul << order);
+        if (s_data.frame_orders[head] == k_not_free) {
+            continue;
+        }
+        if (s_data.frame_orders[head] < order) {
+            // Free blocks can't overlap, so no larger block can contain the frame either.
+            break;
+        }
+        return head;
+    }
+    return {};
+}
+
+void free_block(size_t index, uint8_t order) {
+    // Coalesce with the buddy for as long as it is also free.
+    for (; order < k_max_order; order++) {
+        const auto buddy = index ^ (1ul << order);
+        if (buddy + (1ul << order) > s_data.frame_count || s_data.frame_orders[buddy] != order) {
+            break;
+        }
+        remove_block(buddy);
+        index = ustd::min(index, buddy);
+    }
+    push_block(index, order);
 }
 
-void clear_frame(size_t index) {
-    frame_bitset_bucket(index) &= ~(1ul << (index % k_bucket_bit_count));
+void free_range(size_t first, size_t last) {
+    // Split the range into the largest naturally aligned blocks possible.
+    while (first < last) {
+        auto order = static_cast<uint8_t>(ustd::min(ustd::ctz(first), static_cast<size_t>(k_max_order)));
+        while (first + (1ul << order) > last) {
+            order--;
+        }
+        free_block(first, order);
+        first += 1ul << order;
+    }
+}
+
+ustd::Optional<size_t> allocate_block(uint8_t order) {
+    uint8_t found_order = order;
+    while (found_order <= k_max_order && s_data.free_lists[found_order] == nullptr) {
+        found_order++;
+    }
+    if (found_order > k_max_order) {
+        return {};
+    }
+
+    // Split the block down to the requested order, returning the upper halves to the free lists.
+    const auto index = index_of(s_data.free_lists[found_order]);
+    remove_block(index);
+    while (found_order > order) {
+        found_order--;
+        push_block(index + (1ul << found_order), found_order);
+    }
+    return index;
+}
+
+void reserve_frame(size_t index) {
+    const auto head = containing_block(index);
+    ASSERT(head);
+    const auto order = s_data.frame_orders[*head];
+    remove_block(*head);
+    free_range(*head, index);
+    free_range(index + 1, *head + (1ul << order));
+}
+
+ustd::Atomic<uint32_t> &pin_count_for(uintptr_t frame) {
+    return s_pin_counts[(frame / k_frame_size) % s_pin_counts.size()];
+}
+
+// Frees the given frames, apart from any that are pinned, which are instead marked as freed for the last unpin to free.
+void free_unpinned_range(size_t first, size_t last) {
+    ASSERT(s_lock.is_locked_by_current_cpu());
+    for (auto *pin = s_pins; pin != nullptr; pin = pin->next) {
+        const size_t index = pin->frame / k_frame_size;
+        if (index < first || index >= last) {
+            continue;
+        }
+        for (auto *other = s_pins; other != nullptr; other = other->next) {
+            if (other->frame == pin->frame) {
+                other->freed = true;
+            }
+        }
+        free_unpinned_range(first, index);
+        free_unpinned_range(index + 1, last);
+        return;
+    }
+    free_range(first, last);
 }
 
-void set_frame(size_t index) {
-    frame_bitset_bucket(index) |= 1ul << (index % k_bucket_bit_count);
+// Returns every frame held in any CPU's frame cache to the free lists, so that they can be handed out again and
+// coalesced. Note that no locks may be held by the caller.
+void drain_frame_caches() {
+    for (uint32_t cpu = 0; cpu < arch::cpu_count(); cpu++) {
+        auto *cache = arch::frame_cache(cpu);
+        ScopedLock cache_locker(cache->lock);
+        ScopedLock locker(s_lock);
+        for (uint32_t i = 0; i < cache->count; i++) {
+            ASSERT(!containing_block(cache->frames[i] / k_frame_size));
+            free_block(cache->frames[i] / k_frame_size, 0);
+        }
+        cache->count = 0;
+    }
 }
 
-bool is_frame_set(size_t index) {
-    return (frame_bitset_bucket(index) & (1ul << (index % k_bucket_bit_count))) != 0;
+uint8_t order_for(size_t frame_count) {
+    if (frame_count <= 1) {
+        return 0;
+    }
+    return static_cast<uint8_t>(sizeof(size_t) * 8 - ustd::clz(frame_count - 1));
 }
 
 void parse_memory_map(BootInfo *boot_info) {
@@ -75,40 +230,42 @@ void parse_memory_map(BootInfo *boot_info) {
     ASSERT(memory_end % k_frame_size == 0);
     s_data.frame_count = memory_end / k_frame_size;
 
-    // Find some free memory for the physical frame bitset. We do this by finding the first fit entry in the memory map.
-    const size_t bucket_count = s_data.frame_count / k_bucket_bit_count + 1;
-    const auto bitset_location = find_first_fit_region(boot_info, bucket_count * sizeof(size_t));
-    ENSURE(bitset_location, "Failed to allocate memory for physical frame bitset!");
+    // Find some free memory for the frame order array. We do this by finding the first fit entry in the memory map.
+    const auto orders_location = find_first_fit_region(boot_info, s_data.frame_count);
+    ENSURE(orders_location, "Failed to allocate memory for physical frame orders!");
 
-    // Construct the frame bitset and initially mark all frames as reserved.
-    s_data.frame_bitset = new (reinterpret_cast<void *>(*bitset_location)) size_t[bucket_count];
-    __builtin_memset(s_data.frame_bitset, 0xff, bucket_count * sizeof(size_t));
+    // Construct the frame order array and initially mark all frames as not free.
+    s_data.frame_orders = new (reinterpret_cast<void *>(*orders_location)) uint8_t[s_data.frame_count];
+    __builtin_memset(s_data.frame_orders, k_not_free, s_data.frame_count);
 
-    // Mark available frames as usable. Reclaimable memory will be reclaimed later, after the initial kernel stack is no
-    // longer in use.
+    // Add available frames to the free lists, leaving out the frames of the frame order array itself, since the free
+    // block headers would otherwise be written over it. Reclaimable memory will be reclaimed later, after the initial
+    // kernel stack is no longer in use.
+    const size_t orders_first = *orders_location / k_frame_size;
+    const size_t orders_last = orders_first + ustd::align_up(s_data.frame_count, k_frame_size) / k_frame_size;
     for (size_t i = 0; i < boot_info->map_entry_count; i++) {
         auto &entry = boot_info->map[i];
         if (entry.type != MemoryType::Available) {
             continue;
         }
-        for (size_t j = 0; j < entry.page_count; j++) {
-            clear_frame(entry.base / k_frame_size + j);
+        const size_t first = entry.base / k_frame_size;
+        const size_t last = first + entry.page_count;
+        if (orders_first >= first && orders_first < last) {
+            free_range(first, orders_first);
+            free_range(orders_last, last);
+            continue;
         }
+        free_range(first, last);
     }
 
-    // Remark the memory for the frame bitset itself as reserved.
-    set_frame(0);
-    for (size_t i = 0; i < ustd::align_up(bucket_count * sizeof(size_t), k_frame_size) / k_frame_size; i++) {
-        set_frame(*bitset_location / k_frame_size + i);
+    // Remark the null frame as reserved.
+    if (containing_block(0)) {
+        reserve_frame(0);
     }
 
     // Print some memory info.
-    size_t free_bytes = 0;
-    size_t total_bytes = 0;
-    for (size_t i = 0; i < s_data.frame_count; i++) {
-        free_bytes += !is_frame_set(i) ? k_frame_size : 0;
-        total_bytes += k_frame_size;
-    }
+    const size_t free_bytes = s_data.free_frame_count * k_frame_size;
+    const size_t total_bytes = s_data.frame_count * k_frame_size;
     dmesg(" mem: {}MiB/{}MiB free ({}%)", free_bytes / 1_MiB, total_bytes / 1_MiB, (free_bytes * 100) / total_bytes);
 }
 
@@ -120,7 +277,7 @@ void MemoryManager::initialise(BootInfo *boot_info) {
     // Reserve 0x8000 for the SMP trampoline.
     // TODO: This is x86 specific.
     ENSURE(is_frame_free(0x8000));
-    set_frame(0x8000 / k_frame_size);
+    reserve_frame(0x8000 / k_frame_size);
 
     Heap::initialise();
 
@@ -130,16 +287,15 @@ void MemoryManager::initialise(BootInfo *boot_info) {
 }
 
 void MemoryManager::reclaim(BootInfo *boot_info) {
+    ScopedLock locker(s_lock);
     size_t total_reclaimed = 0;
     for (size_t i = 0; i < boot_info->map_entry_count; i++) {
         auto &entry = boot_info->map[i];
         if (entry.base == 0 || entry.type != MemoryType::Reclaimable) {
             continue;
         }
-        for (size_t j = 0; j < entry.page_count; j++) {
-            clear_frame(entry.base / k_frame_size + j);
-            total_reclaimed += k_frame_size;
-        }
+        free_range(entry.base / k_frame_size, entry.base / k_frame_size + entry.page_count);
+        total_reclaimed += entry.page_count * k_frame_size;
     }
     if (total_reclaimed >= 1_MiB) {
         dmesg(" mem: Reclaimed {}MiB of memory", total_reclaimed / 1_MiB);
@@ -150,52 +306,101 @@ void MemoryManager::reclaim(BootInfo *boot_info) {
     }
 }
 
+// Note that the per-CPU caches are locked, despite interrupts always being disabled in ring 0, only so that another CPU
+// can drain them when it runs out of memory. The lock is otherwise uncontended.
 uintptr_t MemoryManager::alloc_frame() {
-    ScopedLock locker(s_lock);
-    for (size_t i = 0; i < s_data.frame_count; i++) {
-        if (!is_frame_set(i)) {
-            set_frame(i);
-            return i * k_frame_size;
+    auto *cache = arch::frame_cache();
+    if (cache == nullptr) {
+        ScopedLock locker(s_lock);
+        const auto index = allocate_block(0);
+        ENSURE(index, "No available physical memory!");
+        return *index * k_frame_size;
+    }
+
+    {
+        ScopedLock cache_locker(cache->lock);
+        if (cache->count == 0) {
+            ScopedLock locker(s_lock);
+            while (cache->count < cache->batch) {
+                const auto index = allocate_block(0);
+                if (!index) {
+                    break;
+                }
+                cache->frames[cache->count++] = *index * k_frame_size;
+            }
+        }
+        if (cache->count != 0) {
+            return cache->frames[--cache->count];
         }
     }
-    ENSURE_NOT_REACHED("No available physical memory!");
+
+    // The free lists are empty, but other CPUs may still have frames cached, and the heap may be holding on to regions
+    // kept alive only by cached allocations.
+    Heap::drain_caches();
+    drain_frame_caches();
+    ScopedLock locker(s_lock);
+    const auto index = allocate_block(0);
+    ENSURE(index, "No available physical memory!");
+    return *index * k_frame_size;
 }
 
 void MemoryManager::free_frame(uintptr_t frame) {
-    ScopedLock locker(s_lock);
     ASSERT(frame % k_frame_size == 0);
-    const auto index = frame / k_frame_size;
-    ASSERT(is_frame_set(index));
-    clear_frame(index);
+    if (pin_count_for(frame).load(ustd::memory_order_acquire) != 0) {
+        // The frame may be pinned, in which case it mustn't end up in a frame cache.
+        ScopedLock locker(s_lock);
+        ASSERT(!containing_block(frame / k_frame_size));
+        free_unpinned_range(frame / k_frame_size, frame / k_frame_size + 1);
+        return;
+    }
+
+    auto *cache = arch::frame_cache();
+    if (cache == nullptr) {
+        ScopedLock locker(s_lock);
+        ASSERT(!containing_block(frame / k_frame_size));
+        free_block(frame / k_frame_size, 0);
+        return;
+    }
+
+    ScopedLock cache_locker(cache->lock);
+    if (cache->count >= cache->high) {
+        // Drain the oldest frames so that the most recently freed, and so likely cache-hot, frames are kept.
+        ScopedLock locker(s_lock);
+        const auto drain_count = ustd::min(cache->batch, cache->count);
+        for (uint32_t i = 0; i < drain_count; i++) {
+            ASSERT(!containing_block(cache->frames[i] / k_frame_size));
+            free_block(cache->frames[i] / k_frame_size, 0);
+        }
+        for (uint32_t i = drain_count; i < cache->count; i++) {
+            cache->frames[i - drain_count] = cache->frames[i];
+        }
+        cache->count -= drain_count;
+    }
+    cache->frames[cache->count++] = frame;
 }
 
 bool MemoryManager::is_frame_free(uintptr_t frame) {
     ASSERT(frame % k_frame_size == 0);
-    return !is_frame_set(frame / k_frame_size);
+    return containing_block(frame / k_frame_size).has_value();
 }
 
 void *MemoryManager::alloc_contiguous(size_t size) {
-    ScopedLock locker(s_lock);
     const size_t frame_count = ustd::align_up(size, k_frame_size) / k_frame_size;
-    for (size_t i = 0; i < s_data.frame_count; i += frame_count) {
-        bool found_space = true;
-        for (size_t j = i; j < i + frame_count; j++) {
-            if (is_frame_set(j)) {
-                found_space = false;
-                break;
-            }
-        }
-
-        if (!found_space) {
-            continue;
-        }
-
-        for (size_t j = i; j < i + frame_count; j++) {
-            set_frame(j);
-        }
-        return reinterpret_cast<void *>(i * k_frame_size);
+    ScopedLock locker(s_lock);
+    auto index = allocate_block(order_for(frame_count));
+    if (!index && arch::frame_cache() != nullptr) {
+        // Frames sitting in the per-CPU caches can't coalesce, so give them back and try again.
+        locker.unlock();
+        Heap::drain_caches();
+        drain_frame_caches();
+        locker.relock(s_lock);
+        index = allocate_block(order_for(frame_count));
     }
-    ENSURE_NOT_REACHED("No available physical memory!");
+    ENSURE(index, "No available physical memory!");
+
+    // Give back any excess frames at the end of the block.
+    free_range(*index + frame_count, *index + (1ul << order_for(frame_count)));
+    return reinterpret_cast<void *>(*index * k_frame_size);
 }
 
 void MemoryManager::free_contiguous(void *ptr, size_t size) {
@@ -204,9 +409,35 @@ void MemoryManager::free_contiguous(void *ptr, size_t size) {
     ASSERT(first_frame % k_frame_size == 0);
     const auto first_frame_index = first_frame / k_frame_size;
     const size_t frame_count = ustd::align_up(size, k_frame_size) / k_frame_size;
-    for (size_t i = first_frame_index; i < first_frame_index + frame_count; i++) {
-        ASSERT(is_frame_set(i));
-        clear_frame(i);
+    ASSERT(!containing_block(first_frame_index));
+    free_unpinned_range(first_frame_index, first_frame_index + frame_count);
+}
+
+// Pins the frame containing phys so that it isn't reused, even if it gets freed, until the pin is dropped. Note that
+// whatever owns the frame must be kept from freeing it until the pin is in place.
+void MemoryManager::pin_frame(FramePin &pin, uintptr_t phys) {
+    ScopedLock locker(s_lock);
+    pin.frame = ustd::align_down(phys, k_frame_size);
+    pin.next = s_pins;
+    pin.freed = false;
+    s_pins = &pin;
+    pin_count_for(pin.frame).fetch_add(1, ustd::memory_order_release);
+}
+
+void MemoryManager::unpin_frame(FramePin &pin) {
+    ScopedLock locker(s_lock);
+    bool pinned_elsewhere = false;
+    for (auto **link = &s_pins; *link != nullptr;) {
+        if (*link == &pin) {
+            *link = pin.next;
+            continue;
+        }
+        pinned_elsewhere |= (*link)->frame == pin.frame;
+        link = &(*link)->next;
+    }
+    pin_count_for(pin.frame).fetch_sub(1, ustd::memory_order_release);
+    if (pin.freed && !pinned_elsewhere) {
+        free_block(pin.frame / k_frame_size, 0);
     }
 }
 
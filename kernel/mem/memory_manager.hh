@@ -1,5 +1,7 @@
 #pragma once
 
+#include <kernel/spin_lock.hh>
+#include <ustd/array.hh>
 #include <ustd/types.hh>
 
 struct BootInfo;
@@ -8,6 +10,33 @@ namespace kernel {
 
 class VmObject;
 
+constexpr uint32_t k_frame_cache_capacity = 256;
+constexpr uint32_t k_frame_cache_default_batch = 32;
+constexpr uint32_t k_frame_cache_default_high = 128;
+static_assert(k_frame_cache_default_batch <= k_frame_cache_default_high &&
+              k_frame_cache_default_high <= k_frame_cache_capacity);
+
+// A per-CPU list of free 4 KiB frames, stored in the CPU local storage. It is refilled from and drained to the global
+// frame allocator in batches, so that most single frame allocations and frees don't need to take the global lock.
+// The watermarks are per-CPU and may be changed under the lock, as long as batch <= high <= k_frame_cache_capacity:
+// batch is the number of frames moved to or from the free lists at once, and high is the number of frames the cache
+// may hold before it is drained.
+struct FrameCache {
+    ustd::Array<uintptr_t, k_frame_cache_capacity> frames;
+    uint32_t count{0};
+    uint32_t batch{k_frame_cache_default_batch};
+    uint32_t high{k_frame_cache_default_high};
+    SpinLock lock;
+};
+
+// A pin on a frame, which keeps the frame from being reused for as long as the pin is held, even if the frame gets
+// freed in the meantime. Pins are linked together through themselves, so pinning never needs to allocate.
+struct FramePin {
+    uintptr_t frame{0};
+    FramePin *next{nullptr};
+    bool freed{false};
+};
+
 struct MemoryManager {
     static void initialise(BootInfo *boot_info);
     static void reclaim(BootInfo *boot_info);
@@ -15,6 +44,8 @@ struct MemoryManager {
     static uintptr_t alloc_frame();
     static void free_frame(uintptr_t frame);
     static bool is_frame_free(uintptr_t frame);
+    static void pin_frame(FramePin &pin, uintptr_t phys);
+    static void unpin_frame(FramePin &pin);
 
     static void *alloc_contiguous(size_t size);
     static void free_contiguous(void *ptr, size_t size);
@@ -18,6 +18,9 @@ public:
     static PhysicalPage allocate(PhysicalPageSize size);
     static PhysicalPage create(uintptr_t phys, PhysicalPageSize size);
 
+    // An empty page, used for pages of lazy VM objects that haven't been touched yet.
+    PhysicalPage() : m_phys(0) {}
+
     // Maximum physical address size permitted in AMD64 is 52-bits, meaning we can use safely use 8 for the size enum
     // and allocated flag.
     PhysicalPage(uintptr_t phys, PhysicalPageSize size, bool allocated)
@@ -27,11 +30,16 @@ public:
     ~PhysicalPage();
 
     PhysicalPage &operator=(const PhysicalPage &) = delete;
-    PhysicalPage &operator=(PhysicalPage &&) = delete;
+    PhysicalPage &operator=(PhysicalPage &&other) {
+        PhysicalPage moved(ustd::move(other));
+        ustd::swap(m_phys, moved.m_phys);
+        return *this;
+    }
 
     uintptr_t phys() const { return m_phys & 0xfffffffffffffful; }
     PhysicalPageSize size() const { return static_cast<PhysicalPageSize>((m_phys >> 56u) & 0xfu); }
     bool allocated() const { return (m_phys & (1ul << 63u)) != 0u; }
+    bool empty() const { return m_phys == 0u; }
 };
 
 } // namespace kernel
@@ -3,12 +3,18 @@
 #include <kernel/arch/cpu.hh>
 #include <kernel/arch/paging.hh>
 #include <kernel/mem/address_space.hh>
+#include <kernel/mem/slab_cache.hh>
 #include <kernel/mem/vm_object.hh>
 #include <kernel/proc/process.hh>
+#include <kernel/scoped_lock.hh>
+#include <ustd/numeric.hh>
+#include <ustd/optional.hh>
 
 namespace kernel {
 namespace {
 
+SlabCache s_slab_cache("region", sizeof(Region), alignof(Region));
+
 PageFlags page_flags(RegionAccess access) {
     auto flags = static_cast<PageFlags>(0);
     if ((access & RegionAccess::Writable) == RegionAccess::Writable) {
@@ -31,19 +37,67 @@ PageFlags page_flags(RegionAccess access) {
 
 } // namespace
 
+void *Region::operator new(size_t size) {
+    return s_slab_cache.allocate(size);
+}
+
+void Region::operator delete(void *ptr) {
+    s_slab_cache.deallocate(ptr);
+}
+
 Region::Region(AddressSpace &address_space, VirtualRange range, RegionAccess access)
-    : m_address_space(address_space), m_range(range), m_access(access) {}
+    : m_address_space(address_space), m_range(range), m_access(access), m_max_access(access) {}
 
+// Regions are removed from the tree and unmapped by their address space before being destroyed.
 Region::~Region() {
-    m_address_space.detree_region(this);
-    unmap_if_needed();
+    ASSERT(!m_vm_object);
 }
 
-void Region::map(ustd::SharedPtr<VmObject> &&vm_object) {
+// Commits and maps the page containing virt if the region is backed by a lazy VM object. Note that the address space
+// lock must be held, and that the page may have already been mapped by a racing fault.
+ustd::Optional<uintptr_t> Region::commit_page(uintptr_t virt, bool write) {
+    virt = ustd::align_down(virt, 4_KiB);
+    const size_t offset = m_vm_object_offset + (virt - m_range.base());
+    if (!m_vm_object || !m_vm_object->is_lazy() || offset >= m_vm_object->size()) {
+        return {};
+    }
+
+    const auto page = m_vm_object->commit_page(offset / 4_KiB, write);
+    const auto flags = page_flags(page.shared ? m_access & ~RegionAccess::Writable : m_access);
+    auto &page_table = m_address_space.ensure_page_table(virt);
+    const size_t pt_index = (virt >> 12ul) & 0x1fful;
+    const auto &entry = page_table.entries()[pt_index];
+    if (entry.empty()) {
+        page_table.set(pt_index, page.phys, flags);
+    } else if (reinterpret_cast<uintptr_t>(entry.entry()) != page.phys) {
+        // A shared page has been replaced with a private copy.
+        page_table.unset(pt_index);
+        page_table.set(pt_index, page.phys, flags);
+        arch::tlb_flush_range(m_address_space, {virt, 4_KiB});
+    }
+    return page.phys;
+}
+
+// Maps the given VM object into the region, starting offset bytes into the object. Only lazy VM objects may be mapped
+// at an offset or be larger than the region. Note that the address space lock must be held.
+void Region::map_locked(ustd::SharedPtr<VmObject> &&vm_object, size_t offset, bool shared) {
+    ASSERT(m_address_space.m_lock.is_locked_by_current_cpu());
     ASSERT(!m_vm_object);
     m_vm_object = ustd::move(vm_object);
+    m_vm_object_offset = offset;
+    m_shared = shared;
 
-    ASSERT(m_vm_object->size() <= m_range.size());
+    // Pages of lazy VM objects are mapped on first touch by the page fault handler. Note that they may also be shared
+    // with other regions, and so their page list can't be walked without the object's lock. Privately mapped pages are
+    // copied before being written to, so such regions may later be made writable or executable.
+    ASSERT(offset % 4_KiB == 0);
+    if (m_vm_object->is_lazy()) {
+        if (!m_shared) {
+            m_max_access |= RegionAccess::Writable | RegionAccess::Executable;
+        }
+        return;
+    }
+    ASSERT(offset == 0 && m_vm_object->size() <= m_range.size());
 
     const auto flags = page_flags(m_access);
     for (uintptr_t virt = m_range.base(); const auto &physical_page : m_vm_object->physical_pages()) {
@@ -69,11 +123,43 @@ void Region::map(ustd::SharedPtr<VmObject> &&vm_object) {
     arch::tlb_flush_range(m_address_space, m_range);
 }
 
-void Region::unmap_if_needed() {
+void Region::map(ustd::SharedPtr<VmObject> &&vm_object, size_t offset) {
+    ScopedLock lock(m_address_space.m_lock);
+    map_locked(ustd::move(vm_object), offset, false);
+}
+
+// Like map, but for objects whose pages are owned by something else, such as a file, and so must not be released when
+// part of the region is freed.
+void Region::map_shared(ustd::SharedPtr<VmObject> &&vm_object, size_t offset) {
+    ScopedLock lock(m_address_space.m_lock);
+    map_locked(ustd::move(vm_object), offset, true);
+}
+
+// Unmaps the region's pages in the given range and hands back its VM object, so that the caller can release it once the
+// address space lock has been dropped. Only regions backed by lazy VM objects may be partly unmapped, in which case the
+// rest of the region is left mapped for whatever replaces it. Note that the address space lock must be held.
+ustd::SharedPtr<VmObject> Region::unmap(VirtualRange range) {
+    ASSERT(m_address_space.m_lock.is_locked_by_current_cpu());
+    ASSERT(range.base() >= m_range.base() && range.end() <= m_range.end());
     if (!m_vm_object) {
-        return;
+        return {};
     }
 
+    // Only pages which the VM object has committed, or which may come from its source object, can have been faulted
+    // in, so there's no need to look at the page tables for the rest of the range.
+    if (m_vm_object->is_lazy()) {
+        const size_t first_index = (m_vm_object_offset + (range.base() - m_range.base())) / 4_KiB;
+        m_vm_object->for_each_mappable_page(first_index, range.size() / 4_KiB, [&](size_t index) {
+            const uintptr_t virt = m_range.base() + index * 4_KiB - m_vm_object_offset;
+            if (m_address_space.is_mapped_4KiB(virt)) {
+                m_address_space.unmap_4KiB(virt);
+            }
+        });
+        arch::tlb_flush_range(m_address_space, range);
+        return ustd::move(m_vm_object);
+    }
+
+    ASSERT(range.base() == m_range.base() && range.size() == m_range.size());
     for (uintptr_t virt = m_range.base(); const auto &physical_page : m_vm_object->physical_pages()) {
         switch (physical_page.size()) {
         case PhysicalPageSize::Normal:
@@ -91,8 +177,23 @@ void Region::unmap_if_needed() {
         }
     }
 
-    m_vm_object.clear();
     arch::tlb_flush_range(m_address_space, m_range);
+    return ustd::move(m_vm_object);
+}
+
+void Region::update_subtree() {
+    m_subtree_base = m_range.base();
+    m_subtree_end = m_range.end();
+    m_subtree_max_gap = 0;
+    if (auto *left = left_node()) {
+        m_subtree_base = left->m_subtree_base;
+        m_subtree_max_gap = ustd::max(left->m_subtree_max_gap, m_range.base() - left->m_subtree_end);
+    }
+    if (auto *right = right_node()) {
+        m_subtree_end = right->m_subtree_end;
+        m_subtree_max_gap = ustd::max(m_subtree_max_gap, right->m_subtree_max_gap);
+        m_subtree_max_gap = ustd::max(m_subtree_max_gap, right->m_subtree_base - m_range.end());
+    }
 }
 
 ustd::SharedPtr<VmObject> Region::vm_object() const {
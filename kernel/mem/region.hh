@@ -1,8 +1,9 @@
 #pragma once
 
 #include <kernel/mem/virtual_range.hh>
+#include <ustd/optional.hh>
 #include <ustd/shared_ptr.hh>
-#include <ustd/splay_tree.hh> // TODO
+#include <ustd/rb_tree.hh>
 
 namespace kernel {
 
@@ -18,17 +19,31 @@ enum class RegionAccess : uint32_t {
     Global = 1u << 4u,
 };
 
-class Region : public ustd::IntrusiveTreeNode<Region> {
+class Region : public ustd::TreeNodeBase<Region> {
     friend AddressSpace;
 
 private:
     AddressSpace &m_address_space;
     const VirtualRange m_range;
     const RegionAccess m_access;
+    // The most access the region may be given by protect, which is only ever more than the access it was created with
+    // for private lazily backed memory.
+    RegionAccess m_max_access;
     ustd::SharedPtr<VmObject> m_vm_object;
+    size_t m_vm_object_offset{0};
+    bool m_shared{false};
+
+    // The lowest base, the highest end and the largest gap between neighbouring regions in the subtree rooted at this
+    // region, used to search for free ranges.
+    uintptr_t m_subtree_base{0};
+    uintptr_t m_subtree_end{0};
+    size_t m_subtree_max_gap{0};
 
     Region(AddressSpace &, VirtualRange, RegionAccess);
 
+    void map_locked(ustd::SharedPtr<VmObject> &&vm_object, size_t offset, bool shared);
+    ustd::SharedPtr<VmObject> unmap(VirtualRange range);
+
 public:
     Region(const Region &) = delete;
     Region(Region &&) = delete;
@@ -37,14 +52,23 @@ public:
     Region &operator=(const Region &) = delete;
     Region &operator=(Region &&) = delete;
 
-    void map(ustd::SharedPtr<VmObject> &&vm_object);
-    void unmap_if_needed();
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
+
+    ustd::Optional<uintptr_t> commit_page(uintptr_t virt, bool write);
+    void map(ustd::SharedPtr<VmObject> &&vm_object, size_t offset = 0);
+    void map_shared(ustd::SharedPtr<VmObject> &&vm_object, size_t offset);
+    void update_subtree();
 
     uintptr_t base() const { return m_range.base(); }
     AddressSpace &address_space() const { return m_address_space; }
     VirtualRange range() const { return m_range; }
     RegionAccess access() const { return m_access; }
+    RegionAccess max_access() const { return m_max_access; }
     ustd::SharedPtr<VmObject> vm_object() const;
+    uintptr_t subtree_base() const { return m_subtree_base; }
+    uintptr_t subtree_end() const { return m_subtree_end; }
+    size_t subtree_max_gap() const { return m_subtree_max_gap; }
 };
 
 inline constexpr RegionAccess operator&(RegionAccess lhs, RegionAccess rhs) {
@@ -59,4 +83,8 @@ inline constexpr RegionAccess &operator|=(RegionAccess &lhs, RegionAccess rhs) {
     return lhs = (lhs | rhs);
 }
 
+inline constexpr RegionAccess operator~(RegionAccess access) {
+    return static_cast<RegionAccess>(~ustd::to_underlying(access));
+}
+
 } // namespace kernel
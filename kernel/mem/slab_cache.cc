@@ -0,0 +1,64 @@
+#include <kernel/mem/slab_cache.hh>
+
+#include <kernel/mem/memory_manager.hh>
+#include <kernel/scoped_lock.hh>
+#include <kernel/spin_lock.hh>
+#include <ustd/assert.hh>
+#include <ustd/types.hh>
+
+namespace kernel {
+namespace {
+
+SlabCache *s_cache_list = nullptr;
+SpinLock s_cache_list_lock;
+
+} // namespace
+
+SlabCache *SlabCache::first() {
+    ScopedLock locker(s_cache_list_lock);
+    return s_cache_list;
+}
+
+void SlabCache::grow() {
+    auto *slab = static_cast<uint8_t *>(MemoryManager::alloc_contiguous(m_slab_size));
+    const auto object_count = m_slab_size / m_object_size;
+
+    // Thread the new objects onto the free list in address order.
+    for (size_t i = object_count; i > 0; i--) {
+        void *object = slab + (i - 1) * m_object_size;
+        *static_cast<void **>(object) = m_free_list;
+        m_free_list = object;
+    }
+    m_total_count += object_count;
+
+    // Caches are only added to the global list once they are in use so that they can be constant initialised.
+    if (m_slab_count++ == 0) {
+        ScopedLock locker(s_cache_list_lock);
+        m_next = s_cache_list;
+        s_cache_list = this;
+    }
+}
+
+void *SlabCache::allocate(size_t size) {
+    ASSERT(size <= m_object_size);
+    ScopedLock locker(m_lock);
+    if (m_free_list == nullptr) {
+        grow();
+    }
+    void *object = m_free_list;
+    m_free_list = *static_cast<void **>(object);
+    m_active_count++;
+    return object;
+}
+
+void SlabCache::deallocate(void *ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    ScopedLock locker(m_lock);
+    *static_cast<void **>(ptr) = m_free_list;
+    m_free_list = ptr;
+    m_active_count--;
+}
+
+} // namespace kernel
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <kernel/spin_lock.hh>
+#include <ustd/numeric.hh>
+#include <ustd/types.hh>
+
+namespace kernel {
+
+// A cache of fixed size objects carved out of contiguous slabs. Free objects are threaded onto an intrusive free list
+// and handed back out as raw memory, so there is no per-object header and no first-fit scan of the heap regions.
+class SlabCache {
+    const char *const m_name;
+    const size_t m_object_size;
+    const size_t m_slab_size;
+    SpinLock m_lock;
+    void *m_free_list{nullptr};
+    size_t m_active_count{0};
+    size_t m_total_count{0};
+    size_t m_slab_count{0};
+    SlabCache *m_next{nullptr};
+
+    void grow();
+
+public:
+    static SlabCache *first();
+
+    constexpr SlabCache(const char *name, size_t object_size, size_t alignment)
+        : m_name(name), m_object_size(ustd::align_up(ustd::max(object_size, sizeof(void *)), alignment)),
+          m_slab_size(ustd::max(16_KiB, ustd::align_up(m_object_size * 8, 4_KiB))) {}
+    SlabCache(const SlabCache &) = delete;
+    SlabCache(SlabCache &&) = delete;
+
+    SlabCache &operator=(const SlabCache &) = delete;
+    SlabCache &operator=(SlabCache &&) = delete;
+
+    void *allocate(size_t size);
+    void deallocate(void *ptr);
+
+    const char *name() const { return m_name; }
+    size_t object_size() const { return m_object_size; }
+    size_t slab_size() const { return m_slab_size; }
+    size_t active_count() const { return m_active_count; }
+    size_t total_count() const { return m_total_count; }
+    size_t slab_count() const { return m_slab_count; }
+    SlabCache *next() const { return m_next; }
+};
+
+} // namespace kernel
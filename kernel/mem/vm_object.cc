@@ -1,5 +1,15 @@
 #include <kernel/mem/vm_object.hh>
 
+#include <kernel/mem/physical_page.hh>
+#include <kernel/scoped_lock.hh>
+#include <ustd/assert.hh>
+#include <ustd/numeric.hh>
+#include <ustd/optional.hh>
+#include <ustd/shared_ptr.hh>
+#include <ustd/types.hh>
+#include <ustd/utility.hh>
+#include <ustd/vector.hh>
+
 namespace kernel {
 namespace {
 
@@ -33,27 +43,140 @@ ustd::SharedPtr<VmObject> VmObject::create(size_t size) {
     size = ustd::align_up(size, 4_KiB);
     const auto saved_size = size;
 
-    ustd::Vector<PhysicalPage> physical_pages;
+    ustd::LargeVector<PhysicalPage> physical_pages;
     do {
         const auto next_size = size >= 1_GiB ? 1_GiB : size >= 2_MiB ? 2_MiB : 4_KiB;
         physical_pages.push(PhysicalPage::allocate(to_page_size(next_size)));
         size -= next_size;
     } while (size != 0);
-    return ustd::make_shared<VmObject>(ustd::move(physical_pages), saved_size);
+    return ustd::make_shared<VmObject>(ustd::move(physical_pages), saved_size, false);
+}
+
+ustd::SharedPtr<VmObject> VmObject::create_lazy(size_t size) {
+    size = ustd::align_up(size, 4_KiB);
+    ustd::LargeVector<PhysicalPage> physical_pages(size / 4_KiB);
+    return ustd::make_shared<VmObject>(ustd::move(physical_pages), size, true);
 }
 
 ustd::SharedPtr<VmObject> VmObject::create_physical(uintptr_t base, size_t size) {
     size = ustd::align_up(size, 4_KiB);
     const auto saved_size = size;
 
-    ustd::Vector<PhysicalPage> physical_pages;
+    ustd::LargeVector<PhysicalPage> physical_pages;
     do {
         const auto next_size = size >= 1_GiB ? 1_GiB : size >= 2_MiB ? 2_MiB : 4_KiB;
         physical_pages.push(PhysicalPage::create(base, to_page_size(next_size)));
         base += next_size;
         size -= next_size;
     } while (size != 0);
-    return ustd::make_shared<VmObject>(ustd::move(physical_pages), saved_size);
+    return ustd::make_shared<VmObject>(ustd::move(physical_pages), saved_size, false);
+}
+
+// Creates a lazy VM object whose first source_size bytes come from the given source object, starting at source_offset,
+// and the rest of which is zero-filled. Pages fully covered by the source are shared with it until they are written to.
+ustd::SharedPtr<VmObject> VmObject::create_shadow(ustd::SharedPtr<VmObject> source, size_t source_offset,
+                                                  size_t source_size, size_t size) {
+    size = ustd::align_up(size, 4_KiB);
+    ASSERT(source->is_lazy());
+    ASSERT(source_offset % 4_KiB == 0);
+    ASSERT(source_offset + source_size <= source->size() && source_size <= size);
+    ustd::LargeVector<PhysicalPage> physical_pages(size / 4_KiB);
+    return ustd::make_shared<VmObject>(ustd::move(physical_pages), size, ustd::move(source), source_offset,
+                                       source_size);
+}
+
+CommittedPage VmObject::commit_page(size_t index, bool write) {
+    ASSERT(m_lazy);
+    ScopedLock locker(m_lock);
+    auto &physical_page = m_physical_pages[index];
+    if (!physical_page.empty()) {
+        return {physical_page.phys(), false};
+    }
+
+    const size_t offset = index * 4_KiB;
+    if (m_source && !write && offset + 4_KiB <= m_source_size) {
+        return {m_source->commit_page((m_source_offset + offset) / 4_KiB, false).phys, true};
+    }
+
+    // Otherwise allocate a private page, copying in any data from the source and zeroing the rest.
+    physical_page = PhysicalPage::allocate(PhysicalPageSize::Normal);
+    auto *data = reinterpret_cast<uint8_t *>(physical_page.phys());
+    size_t copy_size = 0;
+    if (m_source && offset < m_source_size) {
+        copy_size = ustd::min(4_KiB, m_source_size - offset);
+        const auto source_phys = m_source->commit_page((m_source_offset + offset) / 4_KiB, false).phys;
+        __builtin_memcpy(data, reinterpret_cast<const void *>(source_phys), copy_size);
+    }
+    __builtin_memset(data + copy_size, 0, 4_KiB - copy_size);
+    return {physical_page.phys(), false};
+}
+
+// Releases the private pages in the given range of a lazy object, so that they are zero-filled or taken from the source
+// again if touched.
+void VmObject::decommit(size_t first_index, size_t count) {
+    ASSERT(m_lazy);
+    ScopedLock locker(m_lock);
+    for (size_t index = first_index; index < first_index + count && index < m_physical_pages.size(); index++) {
+        m_physical_pages[index] = {};
+    }
+}
+
+void VmObject::grow(size_t size) {
+    ASSERT(m_lazy && !m_source);
+    ENSURE(size <= k_max_lazy_size);
+    ScopedLock locker(m_lock);
+    size = ustd::align_up(size, 4_KiB);
+    if (size > m_size) {
+        m_physical_pages.ensure_size(size / 4_KiB);
+        m_size = size;
+    }
+}
+
+// Returns the physical address of the page at the given index of a lazy object without committing it.
+ustd::Optional<uintptr_t> VmObject::lookup_page(size_t index) {
+    ASSERT(m_lazy);
+    ScopedLock locker(m_lock);
+    const auto &physical_page = m_physical_pages[index];
+    if (physical_page.empty()) {
+        return {};
+    }
+    return physical_page.phys();
+}
+
+// Returns the physical address backing the given offset into a non-lazy object. The pages of such objects are always
+// laid out largest first, so the page containing the offset can be found directly.
+uintptr_t VmObject::phys_at(size_t offset) const {
+    ASSERT(!m_lazy && offset < m_size);
+    const size_t huge_count = m_size / 1_GiB;
+    if (offset < huge_count * 1_GiB) {
+        return m_physical_pages[offset / 1_GiB].phys() + offset % 1_GiB;
+    }
+    offset -= huge_count * 1_GiB;
+    const size_t large_count = (m_size % 1_GiB) / 2_MiB;
+    if (offset < large_count * 2_MiB) {
+        return m_physical_pages[huge_count + offset / 2_MiB].phys() + offset % 2_MiB;
+    }
+    offset -= large_count * 2_MiB;
+    return m_physical_pages[huge_count + large_count + offset / 4_KiB].phys() + offset % 4_KiB;
+}
+
+// Moves the given pages of a lazy object into a new lazy object without a source, leaving them empty in this one. Pages
+// which would still come from the source object are given a private copy first.
+ustd::SharedPtr<VmObject> VmObject::take_pages(size_t first_index, size_t count) {
+    ASSERT(m_lazy && first_index + count <= m_physical_pages.size());
+    for (size_t index = first_index; m_source && index < first_index + count; index++) {
+        if (index * 4_KiB < m_source_size) {
+            commit_page(index, true);
+        }
+    }
+
+    ustd::LargeVector<PhysicalPage> physical_pages(count);
+    ScopedLock locker(m_lock);
+    for (size_t i = 0; i < count; i++) {
+        physical_pages[i] = ustd::move(m_physical_pages[first_index + i]);
+    }
+    locker.unlock();
+    return ustd::make_shared<VmObject>(ustd::move(physical_pages), count * 4_KiB, true);
 }
 
 } // namespace kernel
@@ -1,28 +1,84 @@
 #pragma once
 
 #include <kernel/mem/physical_page.hh>
+#include <kernel/scoped_lock.hh>
+#include <kernel/spin_lock.hh>
+#include <ustd/assert.hh>
+#include <ustd/numeric.hh>
+#include <ustd/optional.hh>
 #include <ustd/shareable.hh>
 #include <ustd/shared_ptr.hh>
+#include <ustd/types.hh>
+#include <ustd/utility.hh>
 #include <ustd/vector.hh>
 
 namespace kernel {
 
+struct CommittedPage {
+    uintptr_t phys;
+
+    // Whether the page belongs to a source object, in which case it must be mapped read-only so that the first write
+    // to it faults and gives the shadow object its own private copy.
+    bool shared;
+};
+
 class VmObject : public ustd::Shareable<VmObject> {
     USTD_ALLOW_MAKE_SHARED;
 
 private:
-    ustd::Vector<PhysicalPage> m_physical_pages;
+    ustd::LargeVector<PhysicalPage> m_physical_pages;
     size_t m_size;
+    const bool m_lazy;
+    const ustd::SharedPtr<VmObject> m_source;
+    const size_t m_source_offset{0};
+    const size_t m_source_size{0};
+    SpinLock m_lock;
 
-    VmObject(ustd::Vector<PhysicalPage> &&physical_pages, size_t size)
-        : m_physical_pages(ustd::move(physical_pages)), m_size(size) {}
+    VmObject(ustd::LargeVector<PhysicalPage> &&physical_pages, size_t size, bool lazy)
+        : m_physical_pages(ustd::move(physical_pages)), m_size(size), m_lazy(lazy) {}
+    VmObject(ustd::LargeVector<PhysicalPage> &&physical_pages, size_t size, ustd::SharedPtr<VmObject> &&source,
+             size_t source_offset, size_t source_size)
+        : m_physical_pages(ustd::move(physical_pages)), m_size(size), m_lazy(true), m_source(ustd::move(source)),
+          m_source_offset(source_offset), m_source_size(source_size) {}
 
 public:
+    // The largest lazy object, which bounds the size of its page array in the kernel heap. Sizes coming from userspace
+    // must be checked against it before creating an object.
+    static constexpr size_t k_max_lazy_size = 4_GiB;
+
     static ustd::SharedPtr<VmObject> create(size_t size);
+    static ustd::SharedPtr<VmObject> create_lazy(size_t size);
     static ustd::SharedPtr<VmObject> create_physical(uintptr_t base, size_t size);
+    static ustd::SharedPtr<VmObject> create_shadow(ustd::SharedPtr<VmObject> source, size_t source_offset,
+                                                   size_t source_size, size_t size);
+
+    CommittedPage commit_page(size_t index, bool write);
+    void decommit(size_t first_index, size_t count);
+    template <typename F>
+    void for_each_mappable_page(size_t first_index, size_t count, F function);
+    void grow(size_t size);
+    ustd::Optional<uintptr_t> lookup_page(size_t index);
+    uintptr_t phys_at(size_t offset) const;
+    ustd::SharedPtr<VmObject> take_pages(size_t first_index, size_t count);
 
-    const ustd::Vector<PhysicalPage> &physical_pages() const { return m_physical_pages; }
+    const ustd::LargeVector<PhysicalPage> &physical_pages() const { return m_physical_pages; }
     size_t size() const { return m_size; }
+    bool is_lazy() const { return m_lazy; }
 };
 
+// Calls function with the index of every page in the given range of a lazy object which may be mapped into a region,
+// namely those that have been committed and those that may be mapped straight from the source object.
+template <typename F>
+void VmObject::for_each_mappable_page(size_t first_index, size_t count, F function) {
+    ASSERT(m_lazy);
+    ScopedLock locker(m_lock);
+    const size_t source_page_count = ustd::ceil_div(m_source_size, 4_KiB);
+    const size_t end_index = ustd::min(first_index + count, static_cast<size_t>(m_physical_pages.size()));
+    for (size_t index = first_index; index < end_index; index++) {
+        if (index < source_page_count || !m_physical_pages[index].empty()) {
+            function(index);
+        }
+    }
+}
+
 } // namespace kernel
@@ -7,9 +7,11 @@
 #include <kernel/mem/address_space.hh>
 #include <kernel/mem/region.hh>
 #include <kernel/mem/vm_object.hh>
+#include <kernel/proc/wait_queue.hh>
 #include <kernel/sys_result.hh>
 #include <ustd/array.hh>
 #include <ustd/assert.hh>
+#include <ustd/atomic.hh>
 #include <ustd/numeric.hh>
 #include <ustd/scoped_change.hh>
 #include <ustd/span.hh>
@@ -108,7 +110,8 @@ SyscallResult Function::ioctl(ub_ioctl_request_t request, void *) {
         return 0;
     case UB_IOCTL_REQUEST_PCI_ENABLE_INTERRUPTS: {
         auto irq_handler = [this] {
-            m_interrupt_pending = true;
+            m_interrupt_pending.store(true, ustd::memory_order_release);
+            m_interrupt_queue.wake_all();
         };
         enumerate_capabilities([this, &irq_handler](uint32_t cap_ptr, uint32_t cap_reg) {
             switch (cap_reg & 0xffu) {
@@ -171,7 +174,7 @@ uintptr_t Function::mmap(AddressSpace &address_space) const {
 }
 
 SysResult<size_t> Function::read(ustd::Span<void> data, size_t offset) {
-    m_interrupt_pending = false;
+    m_interrupt_pending.store(false, ustd::memory_order_release);
     if (data.data() == nullptr) {
         return 0u;
     }
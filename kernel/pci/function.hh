@@ -2,8 +2,10 @@
 
 #include <kernel/api/types.h>
 #include <kernel/dev/device.hh>
+#include <kernel/proc/wait_queue.hh>
 #include <kernel/sys_result.hh>
 #include <ustd/array.hh>
+#include <ustd/atomic.hh>
 #include <ustd/span.hh> // IWYU pragma: keep
 #include <ustd/types.hh>
 
@@ -30,7 +32,8 @@ class Function final : public Device {
     uint16_t m_vendor_id;
     uint16_t m_device_id;
     ustd::Array<Bar, 6> m_bars{};
-    bool m_interrupt_pending{false};
+    ustd::Atomic<bool> m_interrupt_pending{false};
+    WaitQueue m_interrupt_queue;
 
     template <typename F>
     void enumerate_capabilities(F callback) const;
@@ -43,10 +46,11 @@ public:
     Function(uintptr_t segment_base, uint16_t segment, uint8_t bus, uint8_t device, uint8_t function);
 
     bool read_would_block(size_t) const override { return false; }
-    bool write_would_block(size_t) const override { return !m_interrupt_pending; }
+    bool write_would_block(size_t) const override { return !m_interrupt_pending.load(ustd::memory_order_acquire); }
     SyscallResult ioctl(ub_ioctl_request_t request, void *arg) override;
     uintptr_t mmap(AddressSpace &address_space) const override;
     SysResult<size_t> read(ustd::Span<void> data, size_t offset) override;
+    WaitQueue *write_wait_queue() override { return &m_interrupt_queue; }
 };
 
 } // namespace kernel::pci
@@ -0,0 +1,77 @@
+#include <kernel/proc/futex.hh>
+
+#include <kernel/error.hh>
+#include <kernel/mem/address_space.hh>
+#include <kernel/proc/thread_blocker.hh>
+#include <kernel/scoped_lock.hh>
+#include <kernel/spin_lock.hh>
+#include <kernel/sys_result.hh>
+#include <ustd/array.hh>
+#include <ustd/try.hh>
+#include <ustd/types.hh>
+#include <ustd/vector.hh>
+
+namespace kernel {
+namespace {
+
+constexpr uint32_t k_bucket_count = 64;
+
+struct FutexBucket {
+    SpinLock lock;
+    ustd::Vector<FutexBlocker *> waiters;
+};
+
+ustd::Array<FutexBucket, k_bucket_count> s_buckets;
+
+FutexBucket &bucket_for(uintptr_t phys) {
+    // Fibonacci hashing, taking the top bits of the product.
+    return s_buckets[(phys * 0x9e3779b97f4a7c15ul) >> (64u - __builtin_ctz(k_bucket_count))];
+}
+
+} // namespace
+
+// Resolves the futex word at the given address to its physical address, pinning its frame if a pin is given.
+SysResult<uintptr_t> Futex::resolve(AddressSpace &address_space, uintptr_t address, FramePin *pin) {
+    if (address % sizeof(uint32_t) != 0) {
+        return Error::Invalid;
+    }
+    return TRY(address_space.virt_to_phys(address, pin));
+}
+
+void Futex::add_waiter(FutexBlocker &blocker) {
+    auto &bucket = bucket_for(blocker.phys());
+    ScopedLock locker(bucket.lock);
+    bucket.waiters.push(&blocker);
+}
+
+void Futex::remove_waiter(FutexBlocker &blocker) {
+    auto &bucket = bucket_for(blocker.phys());
+    ScopedLock locker(bucket.lock);
+    for (uint32_t i = 0; i < bucket.waiters.size(); i++) {
+        if (bucket.waiters[i] == &blocker) {
+            bucket.waiters.remove(i);
+            return;
+        }
+    }
+}
+
+size_t Futex::wake(uintptr_t phys, size_t count) {
+    // Woken waiters are taken off the bucket so that they aren't counted again by the next wake. They are woken with
+    // the bucket lock held, since a waiter can't go away without taking it.
+    auto &bucket = bucket_for(phys);
+    ScopedLock locker(bucket.lock);
+    size_t woken_count = 0;
+    for (uint32_t i = 0; i < bucket.waiters.size() && woken_count < count;) {
+        auto *waiter = bucket.waiters[i];
+        if (waiter->phys() != phys) {
+            i++;
+            continue;
+        }
+        bucket.waiters.remove(i);
+        waiter->wake();
+        woken_count++;
+    }
+    return woken_count;
+}
+
+} // namespace kernel
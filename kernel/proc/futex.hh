@@ -0,0 +1,21 @@
+#pragma once
+
+#include <kernel/sys_result.hh>
+#include <ustd/types.hh>
+
+namespace kernel {
+
+class AddressSpace;
+class FutexBlocker;
+struct FramePin;
+
+// Futexes are keyed by the physical address of the futex word, so that threads in different processes can wait on a
+// word in shared memory. Waiting threads are hashed into a fixed set of buckets by that address.
+struct Futex {
+    static SysResult<uintptr_t> resolve(AddressSpace &address_space, uintptr_t address, FramePin *pin = nullptr);
+    static void add_waiter(FutexBlocker &blocker);
+    static void remove_waiter(FutexBlocker &blocker);
+    static size_t wake(uintptr_t phys, size_t count);
+};
+
+} // namespace kernel
@@ -1,11 +1,20 @@
 #include <kernel/proc/process.hh>
 
+#include <kernel/api/types.h>
+#include <kernel/error.hh>
+#include <kernel/fs/file.hh>
 #include <kernel/fs/file_handle.hh>
 #include <kernel/fs/vfs.hh>
+#include <kernel/ipc/doorbell.hh>
 #include <kernel/mem/address_space.hh>
 #include <kernel/mem/memory_manager.hh>
+#include <kernel/mem/region.hh>
+#include <kernel/mem/slab_cache.hh>
 #include <kernel/mem/vm_object.hh>
 #include <kernel/proc/thread.hh>
+#include <kernel/scoped_lock.hh>
+#include <kernel/sys_result.hh>
+#include <kernel/time/time_manager.hh>
 #include <ustd/optional.hh>
 #include <ustd/shared_ptr.hh>
 #include <ustd/try.hh>
@@ -17,10 +26,19 @@
 namespace kernel {
 namespace {
 
+SlabCache s_slab_cache("process", sizeof(Process), alignof(Process));
 size_t s_pid_counter = 0;
 
 } // namespace
 
+void *Process::operator new(size_t size) {
+    return s_slab_cache.allocate(size);
+}
+
+void Process::operator delete(void *ptr) {
+    s_slab_cache.deallocate(ptr);
+}
+
 Process::Process(bool is_kernel) : m_pid(s_pid_counter++), m_is_kernel(is_kernel), m_cwd(Vfs::root_inode()) {
     m_address_space = ustd::make_unique<AddressSpace>(*this);
 
@@ -29,6 +47,16 @@ Process::Process(bool is_kernel) : m_pid(s_pid_counter++), m_is_kernel(is_kernel
     auto *kernel_object = MemoryManager::kernel_object();
     auto &kernel_region = ASSUME(m_address_space->allocate_specific({0, kernel_object->size()}, access));
     kernel_region.map(ustd::adopt_shared(kernel_object));
+
+    // Map the time page read-only into user processes. The kernel's own timekeeping reads it too, so it matters that
+    // the region can't later be made writable, which protect refuses since the page isn't lazily backed. Assertion
+    // builds check this for every process.
+    if (!is_kernel) {
+        auto &time_region =
+            ASSUME(m_address_space->allocate_specific({UB_TIME_PAGE_ADDRESS, 4_KiB}, RegionAccess::UserAccessible));
+        time_region.map(TimeManager::time_page());
+        ASSERT(m_address_space->protect({UB_TIME_PAGE_ADDRESS, 4_KiB}, RegionAccess::Writable).is_error());
+    }
 }
 
 Process::~Process() {
@@ -46,6 +74,21 @@ uint32_t Process::allocate_fd() {
     return m_fds.size() - 1;
 }
 
+// Rings the doorbell behind the given descriptor, handing the CPU over to a thread waiting on it once we block.
+SysResult<> Process::ring_doorbell(uint32_t fd) {
+    ScopedLock lock(m_lock);
+    if (fd >= m_fds.size() || !m_fds[fd]) {
+        return Error::BadFd;
+    }
+    auto &file = m_fds[fd]->file();
+    if (!file.is_doorbell()) {
+        return Error::Invalid;
+    }
+    ustd::SharedPtr<Doorbell> doorbell(&static_cast<Doorbell &>(file));
+    lock.unlock();
+    return doorbell->ring(1, true);
+}
+
 ustd::UniquePtr<Thread> Process::create_thread(ThreadPriority priority) {
     return ustd::make_unique<Thread>(this, priority);
 }
@@ -2,6 +2,7 @@
 
 #include <kernel/fs/file_handle.hh>
 #include <kernel/mem/address_space.hh>
+#include <kernel/proc/wait_queue.hh>
 #include <kernel/spin_lock.hh>
 #include <kernel/sys_result.hh>
 #include <ustd/atomic.hh>
@@ -26,18 +27,24 @@ class Process : public ustd::Shareable<Process> {
 private:
     const size_t m_pid;
     const bool m_is_kernel;
+    // Processes started by the kernel itself have no parent, and are the only ones trusted with real-time priority.
+    ustd::Optional<size_t> m_parent_pid;
     Inode *m_cwd;
     ustd::UniquePtr<AddressSpace> m_address_space;
     ustd::Vector<ustd::Optional<FileHandle>> m_fds;
     ustd::Atomic<size_t> m_thread_count{0};
+    ustd::Atomic<bool> m_exiting{false};
+    WaitQueue m_exit_queue;
     mutable SpinLock m_lock;
 
     explicit Process(bool is_kernel);
 
     uint32_t allocate_fd();
+    SysResult<> ring_doorbell(uint32_t fd);
 
 public:
     static ustd::SharedPtr<Process> from_pid(size_t pid);
+    bool has_thread(size_t tid) const;
 
     Process(const Process &) = delete;
     Process(Process &&) = delete;
@@ -46,6 +53,9 @@ public:
     Process &operator=(const Process &) = delete;
     Process &operator=(Process &&) = delete;
 
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
+
     ustd::UniquePtr<Thread> create_thread(ThreadPriority priority);
 
 #define S(name, ...) SyscallResult sys_##name(__VA_ARGS__);
@@ -54,9 +64,14 @@ public:
 
     size_t pid() const { return m_pid; }
     bool is_kernel() const { return m_is_kernel; }
+    const ustd::Optional<size_t> &parent_pid() const { return m_parent_pid; }
     AddressSpace &address_space() { return *m_address_space; }
-    FileHandle &file_handle(uint32_t fd) { return *m_fds[fd]; }
+    // Returns null if the descriptor isn't open, which the caller must check for even after validating it earlier, as
+    // another thread may have closed it whilst m_lock was dropped.
+    FileHandle *file_handle(uint32_t fd) { return fd < m_fds.size() && m_fds[fd] ? m_fds[fd].operator->() : nullptr; }
     size_t thread_count() const { return m_thread_count.load(ustd::memory_order_relaxed); }
+    bool exiting() const { return m_exiting.load(ustd::memory_order_acquire); }
+    WaitQueue &exit_queue() { return m_exit_queue; }
 };
 
 } // namespace kernel
@@ -11,79 +11,337 @@
 #include <ustd/array.hh>
 #include <ustd/assert.hh>
 #include <ustd/atomic.hh>
+#include <ustd/numeric.hh>
+#include <ustd/rb_tree.hh>
 #include <ustd/shared_ptr.hh>
 #include <ustd/types.hh>
 #include <ustd/unique_ptr.hh>
 #include <ustd/utility.hh>
+#include <ustd/vector.hh>
 
 namespace kernel {
 namespace {
 
-class PriorityQueue {
-    static constexpr uint32_t k_slot_count = 1024;
-    alignas(64) ustd::Array<ustd::Atomic<Thread *>, k_slot_count> m_slots;
-    alignas(64) ustd::Atomic<uint32_t> m_head;
-    alignas(64) ustd::Atomic<uint32_t> m_tail;
+constexpr uint64_t k_ns_per_ms = 1000000;
+
+// How far ahead of the thread with the least CPU time a woken thread is placed, so that threads which sleep a lot, such
+// as interactive ones, get to run soon after waking.
+constexpr uint64_t k_wakeup_credit = k_ns_per_ms / 2;
+
+} // namespace
+
+// A FIFO of runnable threads, linked through the threads themselves.
+class ThreadList {
+    Thread *m_head{nullptr};
+    Thread *m_tail{nullptr};
 
 public:
-    void enqueue(Thread *thread);
-    Thread *dequeue();
+    void push(Thread *thread);
+    Thread *pop();
 };
 
-void PriorityQueue::enqueue(Thread *thread) {
-    uint32_t head = m_head.fetch_add(1, ustd::memory_order_acquire);
-    auto &slot = m_slots[head % k_slot_count];
-    while (!slot.cmpxchg(nullptr, thread, ustd::memory_order_release)) {
-        do {
-            arch::cpu_relax();
-        } while (slot.load(ustd::memory_order_relaxed) != nullptr);
+void ThreadList::push(Thread *thread) {
+    ASSERT(thread->m_run_next == nullptr);
+    if (m_tail != nullptr) {
+        m_tail->m_run_next = thread;
+    } else {
+        m_head = thread;
     }
+    m_tail = thread;
 }
 
-Thread *PriorityQueue::dequeue() {
-    uint32_t tail = m_tail.load(ustd::memory_order_relaxed);
-    do {
-        if (static_cast<int32_t>(m_head.load(ustd::memory_order_relaxed) - tail) <= 0) {
-            return nullptr;
+Thread *ThreadList::pop() {
+    Thread *thread = m_head;
+    if (thread != nullptr) {
+        m_head = ustd::exchange(thread->m_run_next, nullptr);
+        if (m_head == nullptr) {
+            m_tail = nullptr;
+        }
+    }
+    return thread;
+}
+
+// The runnable threads of a fairly shared priority class, ordered by the CPU time they've had so far.
+class FairQueue {
+    ustd::RedBlackTree<uint64_t, Thread, &Thread::vruntime> m_tree;
+    uint64_t m_min_vruntime{0};
+
+public:
+    void push(Thread *thread);
+    Thread *pop(bool migrating);
+};
+
+void FairQueue::push(Thread *thread) {
+    // A thread which has been asleep or has just arrived from another CPU is lifted up close to the least CPU time in
+    // the queue, so that it can't hog the CPU catching up.
+    const auto floor = m_min_vruntime > k_wakeup_credit ? m_min_vruntime - k_wakeup_credit : 0;
+    thread->m_vruntime = ustd::max(thread->m_vruntime, floor);
+    m_tree.insert(thread);
+}
+
+Thread *FairQueue::pop(bool migrating) {
+    auto *thread = m_tree.minimum_node();
+    if (thread == nullptr) {
+        return nullptr;
+    }
+    m_tree.remove(thread);
+    m_min_vruntime = ustd::max(m_min_vruntime, thread->m_vruntime);
+
+    // Virtual runtimes aren't comparable between CPUs, so a migrating thread starts again from the floor of its new
+    // CPU's queue.
+    if (migrating) {
+        thread->m_vruntime = 0;
+    }
+    return thread;
+}
+
+namespace {
+
+struct Timeout {
+    uint64_t deadline;
+    Thread *thread;
+};
+
+// A binary min-heap of timeouts, ordered by deadline.
+class TimeoutHeap {
+    ustd::Vector<Timeout> m_timeouts;
+
+    void sift_up(uint32_t index);
+    void sift_down(uint32_t index);
+
+public:
+    void insert(Timeout timeout);
+    void remove(Thread *thread);
+    Timeout pop();
+
+    bool empty() const { return m_timeouts.empty(); }
+    uint64_t next_deadline() const { return m_timeouts.first().deadline; }
+};
+
+// The run queue of a single CPU. Threads are requeued on the CPU they last ran on so that they keep their caches warm.
+// Other CPUs only ever touch a run queue to steal work from it when they have nothing else to run.
+struct alignas(64) RunQueue {
+    SpinLock lock;
+    ThreadList real_time_list;
+    ustd::Array<FairQueue, 3> fair_queues;
+    ustd::Atomic<uint32_t> size{0};
+    ustd::Atomic<ThreadPriority> running_priority{ThreadPriority::Idle};
+    Thread *idle_thread{nullptr};
+    SchedulerStats stats{};
+
+    // A woken thread to run next, ahead of the queues. Only touched by its own CPU, with interrupts disabled.
+    Thread *handoff_thread{nullptr};
+
+    // Timeouts of threads which blocked on this CPU. The timer is armed for the nearest one.
+    SpinLock timeout_lock;
+    TimeoutHeap timeouts;
+
+    void enqueue(Thread *thread);
+    Thread *dequeue(bool migrating);
+};
+
+void TimeoutHeap::sift_up(uint32_t index) {
+    while (index != 0) {
+        const uint32_t parent = (index - 1) / 2;
+        if (m_timeouts[parent].deadline <= m_timeouts[index].deadline) {
+            break;
         }
-    } while (!m_tail.compare_exchange(tail, tail + 1, ustd::memory_order_acquire));
-    auto &slot = m_slots[tail % k_slot_count];
+        ustd::swap(m_timeouts[parent], m_timeouts[index]);
+        index = parent;
+    }
+}
+
+void TimeoutHeap::sift_down(uint32_t index) {
     while (true) {
-        Thread *thread = slot.exchange(nullptr, ustd::memory_order_release);
-        if (thread != nullptr) {
-            return thread;
+        uint32_t smallest = index;
+        for (uint32_t child = index * 2 + 1; child <= index * 2 + 2 && child < m_timeouts.size(); child++) {
+            if (m_timeouts[child].deadline < m_timeouts[smallest].deadline) {
+                smallest = child;
+            }
+        }
+        if (smallest == index) {
+            break;
+        }
+        ustd::swap(m_timeouts[smallest], m_timeouts[index]);
+        index = smallest;
+    }
+}
+
+void TimeoutHeap::insert(Timeout timeout) {
+    m_timeouts.push(timeout);
+    sift_up(m_timeouts.size() - 1);
+}
+
+void TimeoutHeap::remove(Thread *thread) {
+    for (uint32_t i = 0; i < m_timeouts.size(); i++) {
+        if (m_timeouts[i].thread != thread) {
+            continue;
         }
-        do {
-            arch::cpu_relax();
-        } while (slot.load(ustd::memory_order_relaxed) == nullptr);
+        m_timeouts[i] = m_timeouts.last();
+        m_timeouts.pop();
+        if (i < m_timeouts.size()) {
+            sift_up(i);
+            sift_down(i);
+        }
+        return;
+    }
+}
+
+Timeout TimeoutHeap::pop() {
+    const auto timeout = m_timeouts.first();
+    m_timeouts[0] = m_timeouts.last();
+    m_timeouts.pop();
+    if (!m_timeouts.empty()) {
+        sift_down(0);
+    }
+    return timeout;
+}
+
+// Maps the Batch, Normal and Interactive classes to their fair queue.
+uint32_t fair_queue_index(ThreadPriority priority) {
+    return static_cast<uint32_t>(priority) - static_cast<uint32_t>(ThreadPriority::Batch);
+}
+
+void RunQueue::enqueue(Thread *thread) {
+    ScopedLock locker(lock);
+    const auto priority = thread->priority();
+    if (priority == ThreadPriority::RealTime) {
+        real_time_list.push(thread);
+    } else {
+        fair_queues[fair_queue_index(priority)].push(thread);
     }
+    size.fetch_add(1, ustd::memory_order_relaxed);
+}
+
+Thread *RunQueue::dequeue(bool migrating) {
+    ScopedLock locker(lock);
+    auto *thread = real_time_list.pop();
+    for (auto *queue = fair_queues.end(); thread == nullptr && queue-- != fair_queues.begin();) {
+        thread = queue->pop(migrating);
+    }
+    if (thread != nullptr) {
+        size.fetch_sub(1, ustd::memory_order_relaxed);
+    }
+    return thread;
 }
 
 Thread *s_base_thread;
 SpinLock s_thread_list_lock;
-ustd::Atomic<bool> s_time_being_updated;
 
-PriorityQueue *s_blocked_queue;
-ustd::Array<PriorityQueue *, 2> s_queues;
+ustd::Array<RunQueue, arch::k_max_cpu_count> s_run_queues;
+
+// The set of CPUs running their idle thread. An idle CPU only has its timer armed if it has a pending timeout, so it
+// must be sent an IPI to notice newly queued work.
+ustd::Atomic<uint64_t> s_idle_cpu_set;
 
-Thread *pick_next() {
-    while (auto *thread = s_blocked_queue->dequeue()) {
-        s_queues[static_cast<uint32_t>(thread->priority())]->enqueue(thread);
+RunQueue &current_run_queue() {
+    return s_run_queues[arch::current_cpu()];
+}
+
+void enqueue(Thread *thread) {
+    const auto cpu = thread->cpu();
+    s_run_queues[cpu].enqueue(thread);
+
+    // Kick the thread's own CPU if it's idle. Otherwise kick any idle CPU so that it can steal the thread. The kicked
+    // CPU is removed from the idle set so that it doesn't get sent any more IPIs before it has rescheduled.
+    auto idle_set = s_idle_cpu_set.load(ustd::memory_order_seq_cst);
+    while (idle_set != 0) {
+        const auto target = (idle_set & (1ull << cpu)) != 0 ? cpu : static_cast<uint32_t>(__builtin_ctzll(idle_set));
+        if (s_idle_cpu_set.compare_exchange(idle_set, idle_set & ~(1ull << target), ustd::memory_order_seq_cst)) {
+            arch::send_reschedule_ipi(target);
+            return;
+        }
     }
-    for (auto *queue = s_queues.end(); queue-- != s_queues.begin();) {
-        while (auto *thread = (*queue)->dequeue()) {
-            thread->try_unblock();
-            if (thread->state() == ThreadState::Alive) {
-                return thread;
-            }
-            s_blocked_queue->enqueue(thread);
+
+    // Otherwise preempt the thread's CPU if it's running something of a lower class, rather than making the thread
+    // wait for the end of the time slice.
+    if (thread->priority() > s_run_queues[cpu].running_priority.load(ustd::memory_order_relaxed)) {
+        arch::send_reschedule_ipi(cpu);
+    }
+}
+
+// Makes a woken thread the next to run on the current CPU. The waker must be about to block, typically on a reply from
+// the woken thread, so that the CPU goes straight from one to the other without the woken thread having to wait in a
+// run queue or another CPU having to be kicked.
+void hand_off(Thread *thread) {
+    if (auto *previous = ustd::exchange(current_run_queue().handoff_thread, thread)) {
+        enqueue(previous);
+    }
+}
+
+// Takes a thread from the CPU with the most queued threads, or returns null if no other CPU has any.
+Thread *steal(uint32_t cpu) {
+    uint32_t victim = cpu;
+    uint32_t victim_size = 0;
+    for (uint32_t i = 0; i < arch::cpu_count(); i++) {
+        const auto size = s_run_queues[i].size.load(ustd::memory_order_relaxed);
+        if (i != cpu && size > victim_size) {
+            victim = i;
+            victim_size = size;
         }
     }
-    ENSURE_NOT_REACHED("Thread queue empty!");
+    return victim != cpu ? s_run_queues[victim].dequeue(true) : nullptr;
+}
+
+Thread *pick_next(RunQueue &run_queue, uint32_t cpu) {
+    // Blocked threads are never in a run queue, so whatever is at the front of the highest priority queue can run.
+    if (auto *thread = run_queue.dequeue(false)) {
+        return thread;
+    }
+    if (auto *thread = steal(cpu)) {
+        run_queue.stats.steal_count++;
+        return thread;
+    }
+    return run_queue.idle_thread;
+}
+
+void wake_expired_timeouts(RunQueue &run_queue) {
+    ScopedLock locker(run_queue.timeout_lock);
+    if (run_queue.timeouts.empty()) {
+        return;
+    }
+    const auto now = TimeManager::ns_since_boot();
+    while (!run_queue.timeouts.empty() && run_queue.timeouts.next_deadline() <= now) {
+        Scheduler::wake(*run_queue.timeouts.pop().thread);
+    }
+}
+
+uint64_t time_slice_for(Thread *thread) {
+    // Interactive threads get short slices so that a busy one can't hold up its peers for long, while batch threads get
+    // long ones to cut down on switching.
+    constexpr ustd::Array<uint64_t, k_thread_priority_count> time_slices{
+        0,                // Idle
+        10 * k_ns_per_ms, // Batch
+        4 * k_ns_per_ms,  // Normal
+        2 * k_ns_per_ms,  // Interactive
+        5 * k_ns_per_ms,  // RealTime
+    };
+    return time_slices[static_cast<uint32_t>(thread->priority())];
 }
 
-uint32_t time_slice_for(Thread *thread) {
-    return static_cast<uint32_t>(thread->priority()) + 1u;
+// Arms the timer for the end of the next thread's time slice or the nearest timeout, whichever is sooner. An idle CPU
+// with no timeouts is left without a timer at all.
+void arm_timer(RunQueue &run_queue, Thread *next_thread) {
+    const bool is_idle = next_thread == run_queue.idle_thread;
+    ScopedLock locker(run_queue.timeout_lock);
+    if (run_queue.timeouts.empty()) {
+        locker.unlock();
+        if (is_idle) {
+            arch::timer_cancel();
+        } else {
+            arch::timer_set_one_shot(time_slice_for(next_thread));
+        }
+        return;
+    }
+    const auto deadline = run_queue.timeouts.next_deadline();
+    locker.unlock();
+
+    const auto now = TimeManager::ns_since_boot();
+    auto delay = deadline > now ? deadline - now : 0;
+    if (!is_idle) {
+        delay = ustd::min(delay, time_slice_for(next_thread));
+    }
+    arch::timer_set_one_shot(delay);
 }
 
 } // namespace
@@ -102,17 +360,25 @@ ustd::SharedPtr<Process> Process::from_pid(size_t pid) {
     return {};
 }
 
+bool Process::has_thread(size_t tid) const {
+    ScopedLock locker(s_thread_list_lock);
+    Thread *thread = s_base_thread;
+    do {
+        if (&thread->process() == this && thread->tid() == tid) {
+            return true;
+        }
+        thread = thread->m_next;
+    } while (thread != s_base_thread);
+    return false;
+}
+
 void Scheduler::initialise() {
     // Initialise idle thread and process. We pass null as the entry point as when the thread first gets interrupted,
     // its state will be saved.
     s_base_thread = Thread::create_kernel(nullptr, ThreadPriority::Idle).disown();
     s_base_thread->m_prev = s_base_thread;
     s_base_thread->m_next = s_base_thread;
-
-    s_blocked_queue = new PriorityQueue;
-    for (auto &queue : s_queues) {
-        queue = new PriorityQueue;
-    }
+    s_run_queues[0].idle_thread = s_base_thread;
 }
 
 [[noreturn]] void Scheduler::start_bsp() {
@@ -128,34 +394,155 @@ void Scheduler::insert_thread(ustd::UniquePtr<Thread> &&unique_thread) {
     thread->m_next = s_base_thread;
     thread->m_prev->m_next = thread;
     thread->m_next->m_prev = thread;
-    if (thread->priority() != ThreadPriority::Idle) {
-        s_queues[static_cast<uint32_t>(thread->priority())]->enqueue(thread);
+
+    // New threads start off on the inserting CPU, and get spread out by idle CPUs stealing them. Idle threads are never
+    // queued, and are only run when their CPU has nothing else to do.
+    thread->m_cpu = arch::current_cpu();
+    if (thread->priority() == ThreadPriority::Idle) {
+        current_run_queue().idle_thread = thread;
+        return;
     }
+    enqueue(thread);
+}
+
+void Scheduler::remove_thread(Thread &thread) {
+    ScopedLock locker(s_thread_list_lock);
+    thread.m_prev->m_next = thread.m_next;
+    thread.m_next->m_prev = thread.m_prev;
+}
+
+void Scheduler::kill_process(Process &process) {
+    // Get every other thread of the process into the kernel, where it gets killed once it holds nothing. Blocked
+    // threads are woken, and threads which may be running in user space get their CPU interrupted.
+    process.m_exiting.store(true, ustd::memory_order_release);
+    ScopedLock locker(s_thread_list_lock);
+    Thread *thread = s_base_thread;
+    do {
+        if (&thread->process() == &process && thread != &Thread::current()) {
+            wake(*thread);
+            arch::send_reschedule_ipi(thread->cpu());
+        }
+        thread = thread->m_next;
+    } while (thread != s_base_thread);
+}
+
+void Scheduler::set_priority(Process &process, ThreadPriority priority) {
+    // Threads which are already queued stay in their old class's queue until they next run.
+    ScopedLock locker(s_thread_list_lock);
+    Thread *thread = s_base_thread;
+    do {
+        if (&thread->process() == &process) {
+            thread->m_priority.store(priority, ustd::memory_order_relaxed);
+        }
+        thread = thread->m_next;
+    } while (thread != s_base_thread);
+}
+
+void Scheduler::wake(Thread &thread, bool handoff) {
+    auto state = thread.m_state.load(ustd::memory_order_acquire);
+    while (state == ThreadState::Blocking || state == ThreadState::Blocked) {
+        if (thread.m_state.compare_exchange(state, ThreadState::Alive, ustd::memory_order_acq_rel,
+                                            ustd::memory_order_acquire)) {
+            // A thread which was still Blocking hasn't been switched away from yet, and will requeue itself.
+            if (state == ThreadState::Blocked && handoff) {
+                hand_off(&thread);
+            } else if (state == ThreadState::Blocked) {
+                enqueue(&thread);
+            }
+            return;
+        }
+    }
+}
+
+// Queues any thread handed off to which hasn't been switched to, for when the waker didn't end up blocking after all.
+void Scheduler::flush_handoff() {
+    if (auto *thread = ustd::exchange(current_run_queue().handoff_thread, nullptr)) {
+        enqueue(thread);
+    }
+}
+
+uint32_t Scheduler::add_timeout(Thread &thread, uint64_t deadline) {
+    // The timeout goes on the current CPU, which has its timer rearmed when the thread blocks.
+    const auto cpu = arch::current_cpu();
+    auto &run_queue = s_run_queues[cpu];
+    ScopedLock locker(run_queue.timeout_lock);
+    run_queue.timeouts.insert({deadline, &thread});
+    return cpu;
+}
+
+void Scheduler::remove_timeout(Thread &thread, uint32_t cpu) {
+    auto &run_queue = s_run_queues[cpu];
+    ScopedLock locker(run_queue.timeout_lock);
+    run_queue.timeouts.remove(&thread);
+}
+
+SchedulerStats Scheduler::stats(uint32_t cpu) {
+    return s_run_queues[cpu].stats;
 }
 
 void Scheduler::switch_next(arch::RegisterState *regs) {
-    // Requeue switched from thread if not dead.
+    const auto start_cycles = arch::read_cycle_counter();
+    const auto now = TimeManager::ns_since_boot();
+    const auto cpu = arch::current_cpu();
+    auto &run_queue = s_run_queues[cpu];
+
+    // Requeue switched from thread if it's still runnable. A Blocking thread becomes Blocked and is left out of the run
+    // queues until something wakes it up, unless it was woken before getting here.
     Thread *current_thread = &Thread::current();
-    if (current_thread->m_state != ThreadState::Dead) {
-        s_queues[static_cast<uint32_t>(current_thread->priority())]->enqueue(current_thread);
+    const auto state = current_thread->m_state.load(ustd::memory_order_acquire);
+    current_thread->m_vruntime += now - current_thread->m_run_start;
+    if (current_thread != run_queue.idle_thread && state != ThreadState::Dead &&
+        !(state == ThreadState::Blocking &&
+          current_thread->m_state.cmpxchg(ThreadState::Blocking, ThreadState::Blocked, ustd::memory_order_acq_rel))) {
+        run_queue.enqueue(current_thread);
+    }
+
+    Thread *next_thread = ustd::exchange(run_queue.handoff_thread, nullptr);
+    if (next_thread == nullptr) {
+        next_thread = pick_next(run_queue, cpu);
     }
 
-    Thread *next_thread = pick_next();
+    // Note that we may have been removed from the idle set by another CPU sending us an IPI.
+    const auto cpu_bit = 1ull << cpu;
+    const bool in_idle_set = (s_idle_cpu_set.load(ustd::memory_order_relaxed) & cpu_bit) != 0;
+    if (next_thread == run_queue.idle_thread && !in_idle_set) {
+        // Join the idle set before checking for work one last time, so that anything queued after the check sends us
+        // an IPI.
+        s_idle_cpu_set.fetch_or(cpu_bit, ustd::memory_order_seq_cst);
+        next_thread = pick_next(run_queue, cpu);
+        if (next_thread != run_queue.idle_thread) {
+            s_idle_cpu_set.fetch_and(~cpu_bit, ustd::memory_order_seq_cst);
+        }
+    } else if (next_thread != run_queue.idle_thread && in_idle_set) {
+        s_idle_cpu_set.fetch_and(~cpu_bit, ustd::memory_order_seq_cst);
+    }
+    if (next_thread->m_cpu != cpu) {
+        next_thread->m_cpu = cpu;
+        run_queue.stats.migration_count++;
+    }
+    next_thread->m_run_start = now;
+    run_queue.running_priority.store(next_thread->priority(), ustd::memory_order_relaxed);
     arch::switch_space(next_thread->process().address_space());
 
     // Only delete previous thread after switching address space.
-    if (current_thread->m_state == ThreadState::Dead) {
+    if (state == ThreadState::Dead) {
         delete current_thread;
     }
 
-    arch::timer_set_one_shot(time_slice_for(next_thread));
+    arm_timer(run_queue, next_thread);
     arch::thread_load(regs, next_thread);
+    run_queue.stats.switch_count++;
+    run_queue.stats.switch_cycles += arch::read_cycle_counter() - start_cycles;
 }
 
 void Scheduler::timer_handler(arch::RegisterState *regs) {
-    if (s_time_being_updated.cmpxchg(false, true, ustd::memory_order_acq_rel, ustd::memory_order_acquire)) {
-        TimeManager::update();
-        s_time_being_updated.store(false, ustd::memory_order_release);
+    wake_expired_timeouts(current_run_queue());
+
+    // A thread interrupted in user space holds nothing in the kernel, so it can be killed straight away if its process
+    // is exiting.
+    auto &thread = Thread::current();
+    if (arch::is_user_mode(*regs) && thread.process().exiting()) {
+        thread.kill();
     }
     arch::thread_save(regs);
     switch_next(regs);
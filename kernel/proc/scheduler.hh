@@ -1,5 +1,6 @@
 #pragma once
 
+#include <ustd/types.hh>
 #include <ustd/unique_ptr.hh> // IWYU pragma: keep
 
 namespace kernel::arch {
@@ -10,12 +11,31 @@ struct RegisterState;
 
 namespace kernel {
 
+class Process;
 class Thread;
+enum class ThreadPriority : uint32_t;
+
+// Per-CPU scheduling counters. A migration is a thread being run on a different CPU to the one it last ran on, and a
+// steal is an idle CPU taking a thread from another CPU's run queue.
+struct SchedulerStats {
+    uint64_t switch_count;
+    uint64_t switch_cycles;
+    uint64_t migration_count;
+    uint64_t steal_count;
+};
 
 struct Scheduler {
     static void initialise();
     [[noreturn]] static void start_bsp();
     static void insert_thread(ustd::UniquePtr<Thread> &&thread);
+    static void remove_thread(Thread &thread);
+    static void kill_process(Process &process);
+    static void set_priority(Process &process, ThreadPriority priority);
+    static void wake(Thread &thread, bool handoff = false);
+    static void flush_handoff();
+    static uint32_t add_timeout(Thread &thread, uint64_t deadline);
+    static void remove_timeout(Thread &thread, uint32_t cpu);
+    static SchedulerStats stats(uint32_t cpu);
     static void switch_next(arch::RegisterState *);
     static void timer_handler(arch::RegisterState *);
     static void yield(bool save_state);
@@ -10,10 +10,12 @@
 #include <kernel/mem/address_space.hh>
 #include <kernel/mem/memory_manager.hh>
 #include <kernel/mem/region.hh>
+#include <kernel/mem/slab_cache.hh>
 #include <kernel/mem/vm_object.hh>
 #include <kernel/proc/process.hh>
 #include <kernel/proc/scheduler.hh>
 #include <kernel/proc/thread_blocker.hh>
+#include <kernel/proc/wait_queue.hh>
 #include <kernel/sys_result.hh>
 #include <ustd/assert.hh>
 #include <ustd/atomic.hh>
@@ -35,6 +37,9 @@ namespace {
 
 constexpr size_t k_kernel_stack_size = 32_KiB;
 
+SlabCache s_slab_cache("thread", sizeof(Thread), alignof(Thread));
+ustd::Atomic<size_t> s_tid_counter;
+
 void dump_backtrace([[maybe_unused]] arch::RegisterState *regs) {
     // TODO(GH-9): Backtrace generation is unsafe.
 #ifndef ASSERTIONS
@@ -83,7 +88,16 @@ ustd::UniquePtr<Thread> Thread::create_user(ThreadPriority priority) {
     return process->create_thread(priority);
 }
 
-Thread::Thread(Process *process, ThreadPriority priority) : m_process(process), m_priority(priority) {
+void *Thread::operator new(size_t size) {
+    return s_slab_cache.allocate(size);
+}
+
+void Thread::operator delete(void *ptr) {
+    s_slab_cache.deallocate(ptr);
+}
+
+Thread::Thread(Process *process, ThreadPriority priority)
+    : m_process(process), m_tid(s_tid_counter.fetch_add(1, ustd::memory_order_relaxed)), m_priority(priority) {
     // Don't bother creating a kernel stack for idle threads since they can reuse their AP stack.
     if (priority != ThreadPriority::Idle) {
         m_kernel_stack = new uint8_t[k_kernel_stack_size] + k_kernel_stack_size;
@@ -95,18 +109,19 @@ Thread::Thread(Process *process, ThreadPriority priority) : m_process(process),
 Thread::~Thread() {
     delete[] (m_kernel_stack - k_kernel_stack_size);
     operator delete[](m_simd_region, ustd::align_val_t(64));
-    m_process->m_thread_count.fetch_sub(1, ustd::memory_order_acq_rel);
+
+    // Joiners look for the thread in the thread list, so it must be removed before waking them.
     if (m_prev != nullptr) {
-        ASSERT(m_next != nullptr);
-        m_prev->m_next = m_next;
-        m_next->m_prev = m_prev;
+        Scheduler::remove_thread(*this);
     }
+    m_process->m_thread_count.fetch_sub(1, ustd::memory_order_acq_rel);
+    m_process->m_exit_queue.wake_all();
 }
 
 SysResult<> Thread::exec(ustd::StringView path, const ustd::Vector<ustd::String> &args) {
     auto file = TRY(Vfs::open(path, UB_OPEN_MODE_NONE, m_process->m_cwd));
 
-    auto stack_object = VmObject::create(2_MiB);
+    auto stack_object = VmObject::create_lazy(2_MiB);
     auto &stack_region = TRY(m_process->address_space().allocate_anywhere(
         stack_object->size(), RegionAccess::Writable | RegionAccess::UserAccessible));
     stack_region.map(ustd::move(stack_object));
@@ -132,6 +147,7 @@ SysResult<> Thread::exec(ustd::StringView path, const ustd::Vector<ustd::String>
     if (executable->read({&header, sizeof(elf::Header)}) != sizeof(elf::Header)) {
         return Error::NoExec;
     }
+    auto executable_object = TRY(executable->vm_object());
     for (uint16_t i = 0; i < header.ph_count; i++) {
         elf::ProgramHeader phdr{};
         if (executable->read({&phdr, sizeof(elf::ProgramHeader)}, header.ph_off + header.ph_size * i) !=
@@ -146,10 +162,19 @@ SysResult<> Thread::exec(ustd::StringView path, const ustd::Vector<ustd::String>
         if ((phdr.flags & elf::SegmentFlags::Executable) == elf::SegmentFlags::Executable) {
             access |= RegionAccess::Executable;
         }
-        // TODO: Don't always map writable. We only need to for copying the data in.
-        access |= RegionAccess::Writable;
+        if ((phdr.flags & elf::SegmentFlags::Writable) == elf::SegmentFlags::Writable) {
+            access |= RegionAccess::Writable;
+        }
 
-        auto vm_object = VmObject::create(phdr.memsz + (phdr.vaddr & 0xfffu));
+        // Map the segment straight from the executable's pages, which are shared between every process running it.
+        // Writable segments get a private copy of a page on first write.
+        const size_t page_offset = phdr.vaddr & 0xfffu;
+        if ((phdr.offset & 0xfffu) != page_offset || phdr.offset + phdr.filesz > executable_object->size() ||
+            phdr.memsz > VmObject::k_max_lazy_size) {
+            return Error::NoExec;
+        }
+        auto vm_object = VmObject::create_shadow(executable_object, phdr.offset - page_offset,
+                                                 phdr.filesz + page_offset, phdr.memsz + page_offset);
         auto &region = TRY(m_process->address_space().allocate_anywhere(vm_object->size(), access));
         region.map(ustd::move(vm_object));
 
@@ -157,15 +182,6 @@ SysResult<> Thread::exec(ustd::StringView path, const ustd::Vector<ustd::String>
         if (header.entry >= phdr.vaddr && header.entry < phdr.vaddr + phdr.memsz) {
             m_register_state.rip = region.base() + header.entry - (phdr.vaddr & ~4095u);
         }
-
-        size_t copy_offset = phdr.vaddr & 0xfffu;
-        if (copy_offset + phdr.memsz > region.range().size()) {
-            return Error::NoExec;
-        }
-        if (executable->read({reinterpret_cast<void *>(region.base() + copy_offset), phdr.filesz}, phdr.offset) !=
-            phdr.filesz) {
-            return Error::NoExec;
-        }
     }
 
     // Setup user stack.
@@ -194,7 +210,7 @@ SysResult<> Thread::exec(ustd::StringView path, const ustd::Vector<ustd::String>
     m_register_state.rsi = m_register_state.rsp; // argv
 
     // Allocate some space for heap storage.
-    auto heap_object = VmObject::create(5_MiB);
+    auto heap_object = VmObject::create_lazy(5_MiB);
     auto &heap_region = TRY(m_process->address_space().allocate_specific(
         {6_TiB, heap_object->size()}, RegionAccess::Writable | RegionAccess::UserAccessible));
     heap_region.map(ustd::move(heap_object));
@@ -202,18 +218,26 @@ SysResult<> Thread::exec(ustd::StringView path, const ustd::Vector<ustd::String>
 }
 
 void Thread::kill() {
-    m_state = ThreadState::Dead;
+    m_state.store(ThreadState::Dead, ustd::memory_order_release);
 }
 
-void Thread::try_unblock() {
-    if (m_state != ThreadState::Blocked) {
-        return;
-    }
-    ASSERT_PEDANTIC(m_blocker);
-    if (m_blocker->should_unblock()) {
-        m_blocker.clear();
-        m_state = ThreadState::Alive;
+bool Thread::wait() {
+    // The blocker has already added us to its wait queues, so marking ourselves as Blocking before checking the
+    // condition means that any wakeup after the check cancels the sleep rather than being lost. An exiting process
+    // wakes all of its threads, which then give up waiting so that they can be killed on their way out of the kernel.
+    bool unblocked = false;
+    while (true) {
+        m_state.store(ThreadState::Blocking, ustd::memory_order_seq_cst);
+        unblocked = m_blocker->should_unblock();
+        if (unblocked || m_process->exiting()) {
+            break;
+        }
+        Scheduler::yield(true);
     }
+    m_state.store(ThreadState::Alive, ustd::memory_order_release);
+    m_blocker->stop_waiting();
+    m_blocker.clear();
+    return unblocked;
 }
 
 } // namespace kernel
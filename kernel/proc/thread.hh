@@ -4,6 +4,9 @@
 #include <kernel/proc/scheduler.hh>
 #include <kernel/sys_result.hh>
 #include <ustd/assert.hh>
+#include <ustd/atomic.hh>
+#include <ustd/numeric.hh>
+#include <ustd/rb_tree.hh>
 #include <ustd/shared_ptr.hh>
 #include <ustd/string.hh> // IWYU pragma: keep
 #include <ustd/string_view.hh>
@@ -14,36 +17,65 @@
 
 namespace kernel {
 
+class FairQueue;
 class Process;
 class ThreadBlocker;
+class ThreadList;
 
+// Threads in a higher priority class always run before threads in a lower one. RealTime threads run in FIFO order,
+// whereas the CPU time of threads in the other classes is shared fairly between them.
 enum class ThreadPriority : uint32_t {
     Idle = 0,
-    Normal = 1,
+    Batch = 1,
+    Normal = 2,
+    Interactive = 3,
+    RealTime = 4,
 };
+constexpr uint32_t k_thread_priority_count = 5;
 
+// A thread which is about to sleep is Blocking until it has been switched away from, at which point it becomes Blocked
+// and is no longer in any run queue. Waking a Blocking thread just cancels the sleep.
 enum class ThreadState {
     Alive,
+    Blocking,
     Blocked,
     Dead,
 };
 
-class Thread {
+class Thread : public ustd::TreeNodeBase<Thread> {
+    friend FairQueue;
     friend Process;
     friend Scheduler;
+    friend ThreadList;
 
 private:
     const ustd::SharedPtr<Process> m_process;
+    const size_t m_tid;
     arch::RegisterState m_register_state{};
-    ThreadState m_state{ThreadState::Alive};
-    const ThreadPriority m_priority;
+    ustd::Atomic<ThreadState> m_state{ThreadState::Alive};
+    ustd::Atomic<ThreadPriority> m_priority;
     ustd::UniquePtr<ThreadBlocker> m_blocker;
     uint8_t *m_kernel_stack{nullptr};
     uint8_t *m_simd_region{nullptr};
+    uintptr_t m_tls_base{0};
+
+    // The CPU whose SIMD registers currently hold the thread's state, if any. Managed by the arch code.
+    uint32_t m_simd_cpu{ustd::Limits<uint32_t>::max()};
 
     Thread *m_prev{nullptr};
     Thread *m_next{nullptr};
 
+    // The CPU the thread last ran on, whose run queue it goes back to, and the next thread in that run queue.
+    uint32_t m_cpu{0};
+    Thread *m_run_next{nullptr};
+
+    // The CPU time the thread has had, relative to the other threads in its run queue, and when it last started
+    // running.
+    uint64_t m_vruntime{0};
+    uint64_t m_run_start{0};
+
+    bool wait();
+
 public:
     template <typename F>
     static ustd::UniquePtr<Thread> create_kernel(F function, ThreadPriority priority) {
@@ -62,28 +94,38 @@ public:
     Thread &operator=(const Thread &) = delete;
     Thread &operator=(Thread &&) = delete;
 
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
+
     template <typename T, typename... Args>
-    void block(Args &&...args);
+    bool block(Args &&...args);
     SysResult<> exec(ustd::StringView path, const ustd::Vector<ustd::String> &args = {});
     void kill();
-    void try_unblock();
 
+    void set_simd_cpu(uint32_t simd_cpu) { m_simd_cpu = simd_cpu; }
     void set_simd_region(uint8_t *simd_region) { m_simd_region = simd_region; }
+    void set_tls_base(uintptr_t tls_base) { m_tls_base = tls_base; }
 
     Process &process() const { return *m_process; }
-    ThreadPriority priority() const { return m_priority; }
+    size_t tid() const { return m_tid; }
+    ThreadPriority priority() const { return m_priority.load(ustd::memory_order_relaxed); }
+    uint32_t cpu() const { return m_cpu; }
+    uint64_t vruntime() const { return m_vruntime; }
     arch::RegisterState &register_state() { return m_register_state; }
-    ThreadState state() const { return m_state; }
+    ThreadState state() const { return m_state.load(ustd::memory_order_acquire); }
     uint8_t *kernel_stack() const { return m_kernel_stack; }
+    uint32_t simd_cpu() const { return m_simd_cpu; }
     uint8_t *simd_region() const { return m_simd_region; }
+    uintptr_t tls_base() const { return m_tls_base; }
 };
 
+// Returns false if the wait was cut short because the process is exiting, in which case the blocker's condition may not
+// hold.
 template <typename T, typename... Args>
-void Thread::block(Args &&...args) {
-    ASSERT(m_state != ThreadState::Blocked);
+bool Thread::block(Args &&...args) {
+    ASSERT(!m_blocker);
     m_blocker = ustd::make_unique<T>(ustd::forward<Args>(args)...);
-    m_state = ThreadState::Blocked;
-    Scheduler::yield(true);
+    return wait();
 }
 
 } // namespace kernel
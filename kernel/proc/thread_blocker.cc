@@ -5,61 +5,219 @@
 #include <kernel/fs/file_handle.hh>
 #include <kernel/ipc/server_socket.hh>
 #include <kernel/ipc/socket.hh>
+#include <kernel/mem/memory_manager.hh>
+#include <kernel/mem/slab_cache.hh>
+#include <kernel/proc/futex.hh>
 #include <kernel/proc/process.hh>
+#include <kernel/proc/scheduler.hh>
+#include <kernel/proc/thread.hh>
+#include <kernel/proc/wait_queue.hh>
 #include <kernel/scoped_lock.hh>
 #include <kernel/spin_lock.hh>
 #include <kernel/time/time_manager.hh>
+#include <ustd/atomic.hh>
+#include <ustd/numeric.hh>
 #include <ustd/optional.hh>
 #include <ustd/shared_ptr.hh>
 #include <ustd/types.hh>
+#include <ustd/utility.hh>
 #include <ustd/vector.hh>
 
 namespace kernel {
+namespace {
+
+// A thread has at most one blocker at a time, so all of the blocker types share a single cache.
+constexpr size_t k_max_blocker_size =
+    ustd::max(ustd::max(ustd::max(sizeof(AcceptBlocker), sizeof(ConnectBlocker)),
+                        ustd::max(sizeof(FutexBlocker), sizeof(JoinBlocker))),
+              ustd::max(ustd::max(sizeof(PollBlocker), sizeof(ReadBlocker)),
+                        ustd::max(sizeof(WaitBlocker), sizeof(WriteBlocker))));
+
+SlabCache s_slab_cache("thread_blocker", k_max_blocker_size, alignof(ThreadBlocker));
+
+} // namespace
+
+void *ThreadBlocker::operator new(size_t size) {
+    return s_slab_cache.allocate(size);
+}
+
+void ThreadBlocker::operator delete(void *ptr) {
+    s_slab_cache.deallocate(ptr);
+}
+
+// Blockers keep the queues they wait on inline, so that blocking doesn't need to allocate, unless they provide storage
+// of their own with use_queue_storage.
+ThreadBlocker::ThreadBlocker()
+    : m_thread(Thread::current()), m_queues(m_inline_queues.data(), m_inline_queues.size()) {}
+
+ThreadBlocker::~ThreadBlocker() {
+    ASSERT(m_queue_count == 0 && !m_timeout_cpu);
+}
+
+void ThreadBlocker::use_queue_storage(ustd::Span<WaitQueue *> storage) {
+    ASSERT(m_queue_count == 0);
+    m_queues = storage;
+}
+
+void ThreadBlocker::wait_on(WaitQueue &queue) {
+    ENSURE(m_queue_count < m_queues.size());
+    queue.add(m_thread);
+    m_queues[m_queue_count++] = &queue;
+}
+
+void ThreadBlocker::wait_until(uint64_t deadline) {
+    m_timeout_cpu.emplace(Scheduler::add_timeout(m_thread, deadline));
+}
+
+void ThreadBlocker::stop_waiting() {
+    for (size_t i = 0; i < m_queue_count; i++) {
+        m_queues[i]->remove(m_thread);
+    }
+    m_queue_count = 0;
+    if (m_timeout_cpu) {
+        Scheduler::remove_timeout(m_thread, *m_timeout_cpu);
+        m_timeout_cpu.clear();
+    }
+}
+
+AcceptBlocker::AcceptBlocker(ustd::SharedPtr<ServerSocket> server) : m_server(ustd::move(server)) {
+    wait_on(m_server->accept_queue());
+}
 
 bool AcceptBlocker::should_unblock() {
     return !m_server->accept_would_block();
 }
 
+ConnectBlocker::ConnectBlocker(ustd::SharedPtr<Socket> socket) : m_socket(ustd::move(socket)) {
+    wait_on(m_socket->connect_queue());
+}
+
 bool ConnectBlocker::should_unblock() {
     return m_socket->connected();
 }
 
+// The pin keeps the frame of the futex word from being reused whilst we wait, in case the memory gets freed, and is
+// dropped along with the blocker.
+FutexBlocker::FutexBlocker(uintptr_t phys, FramePin &pin, uint32_t expected, ssize_t timeout)
+    : m_phys(phys), m_pin(pin), m_expected(expected) {
+    // As with poll, a negative timeout means to wait forever.
+    if (timeout >= 0) {
+        m_deadline.emplace(TimeManager::ns_since_boot() + static_cast<size_t>(timeout));
+        wait_until(*m_deadline);
+    }
+    Futex::add_waiter(*this);
+}
+
+FutexBlocker::~FutexBlocker() {
+    Futex::remove_waiter(*this);
+    MemoryManager::unpin_frame(m_pin);
+}
+
+void FutexBlocker::wake() {
+    m_woken.store(true, ustd::memory_order_release);
+    Scheduler::wake(thread());
+}
+
+bool FutexBlocker::should_unblock() {
+    // Being on the bucket before checking the futex word means that a wake after the word changes can't be missed.
+    if (m_woken.load(ustd::memory_order_acquire)) {
+        return true;
+    }
+    if (m_deadline && TimeManager::ns_since_boot() >= *m_deadline) {
+        return true;
+    }
+    return *reinterpret_cast<volatile uint32_t *>(m_phys) != m_expected;
+}
+
+JoinBlocker::JoinBlocker(Process &process, size_t tid) : m_process(process), m_tid(tid) {
+    wait_on(process.exit_queue());
+}
+
+bool JoinBlocker::should_unblock() {
+    return !m_process.has_thread(m_tid);
+}
+
 PollBlocker::PollBlocker(const ustd::LargeVector<ub_poll_fd_t> &fds, SpinLock &lock, Process &process, ssize_t timeout)
     : m_fds(fds), m_lock(lock), m_process(process) {
-    if (timeout > 0) {
+    // A negative timeout means to wait forever, and a timeout of zero means not to wait at all.
+    if (timeout >= 0) {
         m_deadline.emplace(TimeManager::ns_since_boot() + static_cast<size_t>(timeout));
+        wait_until(*m_deadline);
+    }
+
+    // Each descriptor can need both of its file's queues, which is more than fit inline.
+    m_queue_storage.ensure_size(m_fds.size() * 2);
+    use_queue_storage({m_queue_storage.data(), m_queue_storage.size()});
+
+    // Keep the files alive for as long as we're on their wait queues, in case their descriptors get closed.
+    ScopedLock locker(m_lock);
+    for (const auto &poll_fd : m_fds) {
+        // A descriptor closed by another thread leaves nothing to wait on, and makes should_unblock return straight
+        // away.
+        auto *handle = m_process.file_handle(poll_fd.fd);
+        if (handle == nullptr) {
+            continue;
+        }
+        auto &file = handle->file();
+        auto *read_queue = file.read_wait_queue();
+        if ((poll_fd.events & UB_POLL_EVENT_READ) == UB_POLL_EVENT_READ && read_queue != nullptr) {
+            wait_on(*read_queue);
+        }
+        auto *write_queue = file.write_wait_queue();
+        if ((poll_fd.events & UB_POLL_EVENT_WRITE) == UB_POLL_EVENT_WRITE && write_queue != nullptr) {
+            wait_on(*write_queue);
+        }
+        m_files.emplace(&file);
     }
 }
 
 bool PollBlocker::should_unblock() {
-    if (m_deadline && TimeManager::ns_since_boot() > *m_deadline) {
+    if (m_deadline && TimeManager::ns_since_boot() >= *m_deadline) {
         return true;
     }
 
     ScopedLock lock(m_lock);
     for (const auto &poll_fd : m_fds) {
-        // TODO: Bounds checking.
-        auto &handle = m_process.file_handle(poll_fd.fd);
-        if ((poll_fd.events & UB_POLL_EVENT_READ) == UB_POLL_EVENT_READ && !handle.read_would_block()) {
+        auto *handle = m_process.file_handle(poll_fd.fd);
+        if (handle == nullptr) {
             return true;
         }
-        if ((poll_fd.events & UB_POLL_EVENT_WRITE) == UB_POLL_EVENT_WRITE && !handle.write_would_block()) {
+        if ((poll_fd.events & UB_POLL_EVENT_READ) == UB_POLL_EVENT_READ && !handle->read_would_block()) {
+            return true;
+        }
+        if ((poll_fd.events & UB_POLL_EVENT_WRITE) == UB_POLL_EVENT_WRITE && !handle->write_would_block()) {
             return true;
         }
     }
     return false;
 }
 
+ReadBlocker::ReadBlocker(File &file, size_t offset) : m_file(&file), m_offset(offset) {
+    if (auto *queue = m_file->read_wait_queue()) {
+        wait_on(*queue);
+    }
+}
+
 bool ReadBlocker::should_unblock() {
     return !m_file->valid() || !m_file->read_would_block(m_offset);
 }
 
-WaitBlocker::WaitBlocker(size_t pid) : m_process(Process::from_pid(pid)) {}
+WaitBlocker::WaitBlocker(size_t pid) : m_process(Process::from_pid(pid)) {
+    if (m_process) {
+        wait_on(m_process->exit_queue());
+    }
+}
 
 bool WaitBlocker::should_unblock() {
     return !m_process || m_process->thread_count() == 0;
 }
 
+WriteBlocker::WriteBlocker(File &file, size_t offset) : m_file(&file), m_offset(offset) {
+    if (auto *queue = m_file->write_wait_queue()) {
+        wait_on(*queue);
+    }
+}
+
 bool WriteBlocker::should_unblock() {
     return !m_file->valid() || !m_file->write_would_block(m_offset);
 }
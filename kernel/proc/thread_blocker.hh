@@ -4,8 +4,11 @@
 #include <kernel/ipc/server_socket.hh>
 #include <kernel/ipc/socket.hh>
 #include <kernel/proc/process.hh>
+#include <ustd/array.hh>
+#include <ustd/atomic.hh>
 #include <ustd/optional.hh>
 #include <ustd/shared_ptr.hh>
+#include <ustd/span.hh>
 #include <ustd/types.hh>
 #include <ustd/utility.hh>
 #include <ustd/vector.hh>
@@ -13,18 +16,40 @@
 namespace kernel {
 
 typedef struct ub_poll_fd ub_poll_fd_t;
+struct FramePin;
 class SpinLock;
+class Thread;
+class WaitQueue;
 
+// Describes what a blocked thread is waiting for. A blocker adds the thread to the wait queues of everything that can
+// make should_unblock true, and the thread is only rescheduled when one of those queues is woken up.
 class ThreadBlocker {
+    Thread &m_thread;
+    ustd::Array<WaitQueue *, 2> m_inline_queues{};
+    ustd::Span<WaitQueue *> m_queues;
+    size_t m_queue_count{0};
+    ustd::Optional<uint32_t> m_timeout_cpu;
+
+protected:
+    void use_queue_storage(ustd::Span<WaitQueue *> storage);
+    void wait_on(WaitQueue &queue);
+    void wait_until(uint64_t deadline);
+
+    Thread &thread() const { return m_thread; }
+
 public:
-    ThreadBlocker() = default;
+    ThreadBlocker();
     ThreadBlocker(const ThreadBlocker &) = delete;
     ThreadBlocker(ThreadBlocker &&) = delete;
-    virtual ~ThreadBlocker() = default;
+    virtual ~ThreadBlocker();
 
     ThreadBlocker &operator=(const ThreadBlocker &) = delete;
     ThreadBlocker &operator=(ThreadBlocker &&) = delete;
 
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
+
+    void stop_waiting();
     virtual bool should_unblock() = 0;
 };
 
@@ -32,7 +57,7 @@ class AcceptBlocker : public ThreadBlocker {
     ustd::SharedPtr<ServerSocket> m_server;
 
 public:
-    explicit AcceptBlocker(ustd::SharedPtr<ServerSocket> server) : m_server(ustd::move(server)) {}
+    explicit AcceptBlocker(ustd::SharedPtr<ServerSocket> server);
 
     bool should_unblock() override;
 };
@@ -41,7 +66,34 @@ class ConnectBlocker : public ThreadBlocker {
     ustd::SharedPtr<Socket> m_socket;
 
 public:
-    explicit ConnectBlocker(ustd::SharedPtr<Socket> socket) : m_socket(ustd::move(socket)) {}
+    explicit ConnectBlocker(ustd::SharedPtr<Socket> socket);
+
+    bool should_unblock() override;
+};
+
+class FutexBlocker final : public ThreadBlocker {
+    const uintptr_t m_phys;
+    FramePin &m_pin;
+    const uint32_t m_expected;
+    ustd::Atomic<bool> m_woken{false};
+    ustd::Optional<size_t> m_deadline;
+
+public:
+    FutexBlocker(uintptr_t phys, FramePin &pin, uint32_t expected, ssize_t timeout);
+    ~FutexBlocker() override;
+
+    void wake();
+    bool should_unblock() override;
+
+    uintptr_t phys() const { return m_phys; }
+};
+
+class JoinBlocker final : public ThreadBlocker {
+    const Process &m_process;
+    const size_t m_tid;
+
+public:
+    JoinBlocker(Process &process, size_t tid);
 
     bool should_unblock() override;
 };
@@ -50,6 +102,8 @@ class PollBlocker : public ThreadBlocker {
     const ustd::LargeVector<ub_poll_fd_t> &m_fds;
     SpinLock &m_lock;
     Process &m_process;
+    ustd::Vector<ustd::SharedPtr<File>> m_files;
+    ustd::LargeVector<WaitQueue *> m_queue_storage;
     ustd::Optional<size_t> m_deadline;
 
 public:
@@ -63,7 +117,7 @@ class ReadBlocker : public ThreadBlocker {
     size_t m_offset;
 
 public:
-    ReadBlocker(File &file, size_t offset) : m_file(&file), m_offset(offset) {}
+    ReadBlocker(File &file, size_t offset);
 
     bool should_unblock() override;
 };
@@ -82,7 +136,7 @@ class WriteBlocker : public ThreadBlocker {
     size_t m_offset;
 
 public:
-    WriteBlocker(File &file, size_t offset) : m_file(&file), m_offset(offset) {}
+    WriteBlocker(File &file, size_t offset);
 
     bool should_unblock() override;
 };
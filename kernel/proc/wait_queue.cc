@@ -0,0 +1,51 @@
+#include <kernel/proc/wait_queue.hh>
+
+#include <kernel/proc/scheduler.hh>
+#include <kernel/scoped_lock.hh>
+#include <kernel/spin_lock.hh>
+#include <ustd/assert.hh>
+#include <ustd/atomic.hh>
+#include <ustd/types.hh>
+#include <ustd/utility.hh>
+#include <ustd/vector.hh>
+
+namespace kernel {
+
+WaitQueue::~WaitQueue() {
+    ASSERT(m_threads.empty());
+}
+
+void WaitQueue::add(Thread &thread) {
+    ScopedLock locker(m_lock);
+    m_threads.push(&thread);
+    m_thread_count.fetch_add(1, ustd::memory_order_seq_cst);
+}
+
+void WaitQueue::remove(Thread &thread) {
+    ScopedLock locker(m_lock);
+    for (uint32_t i = 0; i < m_threads.size(); i++) {
+        if (m_threads[i] == &thread) {
+            m_threads.remove(i);
+            m_thread_count.fetch_sub(1, ustd::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+// With handoff set, the first thread is switched to directly once the caller blocks. See Scheduler::wake.
+void WaitQueue::wake_all(bool handoff) {
+    // Skip taking the lock if nobody is waiting, which is the common case for wakers like pipe writers. A waiter adds
+    // itself before checking its condition, and the waker changes the condition before getting here, so the fence makes
+    // sure that at least one of them sees the other.
+    ustd::atomic_thread_fence(ustd::memory_order_seq_cst);
+    if (m_thread_count.load(ustd::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    ScopedLock locker(m_lock);
+    for (auto *thread : m_threads) {
+        Scheduler::wake(*thread, ustd::exchange(handoff, false));
+    }
+}
+
+} // namespace kernel
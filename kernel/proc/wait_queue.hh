@@ -0,0 +1,33 @@
+#pragma once
+
+#include <kernel/spin_lock.hh>
+#include <ustd/atomic.hh>
+#include <ustd/types.hh>
+#include <ustd/vector.hh>
+
+namespace kernel {
+
+class Thread;
+
+// A set of threads waiting for an event. Threads stay on the queue until they stop waiting, rather than being removed
+// when woken, so that a thread which wakes up to find its condition still false can go straight back to sleep.
+class WaitQueue {
+    ustd::Vector<Thread *> m_threads;
+    ustd::Atomic<uint32_t> m_thread_count{0};
+    mutable SpinLock m_lock;
+
+public:
+    WaitQueue() = default;
+    WaitQueue(const WaitQueue &) = delete;
+    WaitQueue(WaitQueue &&) = delete;
+    ~WaitQueue();
+
+    WaitQueue &operator=(const WaitQueue &) = delete;
+    WaitQueue &operator=(WaitQueue &&) = delete;
+
+    void add(Thread &thread);
+    void remove(Thread &thread);
+    void wake_all(bool handoff = false);
+};
+
+} // namespace kernel
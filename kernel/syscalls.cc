@@ -10,14 +10,20 @@
 #include <kernel/fs/inode_file.hh>
 #include <kernel/fs/ram_fs.hh>
 #include <kernel/fs/vfs.hh>
-#include <kernel/ipc/double_buffer.hh>
+#include <kernel/ipc/byte_ring.hh>
+#include <kernel/ipc/doorbell.hh>
+#include <kernel/ipc/handle_queue.hh>
+#include <kernel/ipc/page_queue.hh>
 #include <kernel/ipc/pipe.hh>
 #include <kernel/ipc/server_socket.hh>
+#include <kernel/ipc/shared_memory.hh>
 #include <kernel/ipc/socket.hh>
 #include <kernel/mem/address_space.hh>
+#include <kernel/mem/memory_manager.hh>
 #include <kernel/mem/physical_page.hh>
 #include <kernel/mem/region.hh>
 #include <kernel/mem/vm_object.hh>
+#include <kernel/proc/futex.hh>
 #include <kernel/proc/scheduler.hh>
 #include <kernel/proc/thread.hh>
 #include <kernel/proc/thread_blocker.hh>
@@ -26,6 +32,7 @@
 #include <kernel/sys_result.hh>
 #include <kernel/time/time_manager.hh>
 #include <ustd/assert.hh>
+#include <ustd/numeric.hh>
 #include <ustd/optional.hh>
 #include <ustd/shared_ptr.hh>
 #include <ustd/string.hh>
@@ -37,6 +44,23 @@
 #include <ustd/vector.hh>
 
 namespace kernel {
+namespace {
+
+RegionAccess region_access(ub_memory_prot_t prot) {
+    auto access = RegionAccess::UserAccessible;
+    if ((prot & UB_MEMORY_PROT_WRITE) == UB_MEMORY_PROT_WRITE) {
+        access |= RegionAccess::Writable;
+    }
+    if ((prot & UB_MEMORY_PROT_EXEC) == UB_MEMORY_PROT_EXEC) {
+        access |= RegionAccess::Executable;
+    }
+    if ((prot & UB_MEMORY_PROT_UNCACHEABLE) == UB_MEMORY_PROT_UNCACHEABLE) {
+        access |= RegionAccess::Uncacheable;
+    }
+    return access;
+}
+
+} // namespace
 
 SyscallResult Process::sys_accept(uint32_t fd) {
     ScopedLock lock(m_lock);
@@ -52,8 +76,9 @@ SyscallResult Process::sys_accept(uint32_t fd) {
     lock.unlock();
 
     auto &server = static_cast<ServerSocket &>(file);
-    if (server.accept_would_block()) {
-        Thread::current().block<AcceptBlocker>(ustd::SharedPtr<ServerSocket>(&server));
+    if (server.accept_would_block() &&
+        !Thread::current().block<AcceptBlocker>(ustd::SharedPtr<ServerSocket>(&server))) {
+        return Error::Interrupted;
     }
     auto accepted = server.accept();
 
@@ -64,20 +89,15 @@ SyscallResult Process::sys_accept(uint32_t fd) {
 }
 
 SyscallResult Process::sys_allocate_region(size_t size, ub_memory_prot_t prot) {
-    size = ustd::align_up(size, 4_KiB);
-
-    auto access = RegionAccess::UserAccessible;
-    if ((prot & UB_MEMORY_PROT_WRITE) == UB_MEMORY_PROT_WRITE) {
-        access |= RegionAccess::Writable;
-    }
-    if ((prot & UB_MEMORY_PROT_EXEC) == UB_MEMORY_PROT_EXEC) {
-        access |= RegionAccess::Executable;
-    }
-    if ((prot & UB_MEMORY_PROT_UNCACHEABLE) == UB_MEMORY_PROT_UNCACHEABLE) {
-        access |= RegionAccess::Uncacheable;
+    if (size > VmObject::k_max_lazy_size) {
+        return Error::Invalid;
     }
+    size = ustd::align_up(size, 4_KiB);
+    const auto access = region_access(prot);
 
-    auto vm_object = VmObject::create(size);
+    // Uncacheable memory is likely going to be used for DMA, so back it eagerly with physically contiguous pages.
+    auto vm_object = (access & RegionAccess::Uncacheable) == RegionAccess::Uncacheable ? VmObject::create(size)
+                                                                                        : VmObject::create_lazy(size);
     auto &region = TRY(m_address_space->allocate_anywhere(size, access));
     region.map(ustd::move(vm_object));
     return region.base();
@@ -90,6 +110,16 @@ SyscallResult Process::sys_bind(uint32_t fd, const char *path) {
     return fd;
 }
 
+// Rings the doorbell ring_fd and then reads the doorbell wait_fd, for a client making a synchronous request over shared
+// memory. The thread waiting on ring_fd gets the CPU straight away when we block waiting for its reply.
+SyscallResult Process::sys_call(uint32_t ring_fd, uint32_t wait_fd) {
+    TRY(ring_doorbell(ring_fd));
+    uint64_t count = 0;
+    const auto result = sys_read(wait_fd, &count, sizeof(count));
+    Scheduler::flush_handoff();
+    return result;
+}
+
 SyscallResult Process::sys_chdir(const char *path) {
     ScopedLock lock(m_lock);
     m_cwd = TRY(Vfs::open_directory(path, m_cwd));
@@ -110,18 +140,34 @@ SyscallResult Process::sys_connect(const char *path) {
     if (!file->is_server_socket()) {
         return Error::Invalid;
     }
-    auto client = ustd::make_shared<Socket>(new DoubleBuffer(64_KiB), new DoubleBuffer(64_KiB));
+    auto client = ustd::make_shared<Socket>(new ByteRing(64_KiB), new ByteRing(64_KiB), new PageQueue, new PageQueue,
+                                            new HandleQueue, new HandleQueue);
     auto &server = static_cast<ServerSocket &>(*file);
     if (auto rc = server.queue_connection_from(client); rc.is_error()) {
         return rc.error();
     }
-    Thread::current().block<ConnectBlocker>(client);
+    if (!Thread::current().block<ConnectBlocker>(client)) {
+        return Error::Interrupted;
+    }
     ScopedLock lock(m_lock);
     uint32_t client_fd = allocate_fd();
     m_fds[client_fd].emplace(client);
     return client_fd;
 }
 
+SyscallResult Process::sys_create_doorbell(uint32_t *fds) {
+    ScopedLock lock(m_lock);
+    auto doorbell = ustd::make_shared<Doorbell>();
+    uint32_t wait_fd = allocate_fd();
+    m_fds[wait_fd].emplace(doorbell, AttachDirection::Read);
+    fds[0] = wait_fd;
+
+    uint32_t ring_fd = allocate_fd();
+    m_fds[ring_fd].emplace(doorbell, AttachDirection::Write);
+    fds[1] = ring_fd;
+    return 0;
+}
+
 SyscallResult Process::sys_create_pipe(uint32_t *fds) {
     ScopedLock lock(m_lock);
     auto pipe = ustd::make_shared<Pipe>();
@@ -139,6 +185,7 @@ SyscallResult Process::sys_create_process(const char *path, const char **argv, u
     ScopedLock lock(m_lock);
     auto new_thread = Thread::create_user(ThreadPriority::Normal);
     auto &new_process = new_thread->process();
+    new_process.m_parent_pid.emplace(m_pid);
     new_process.m_cwd = m_cwd;
     new_process.m_fds.ensure_size(m_fds.size());
     for (uint32_t i = 0; i < m_fds.size(); i++) {
@@ -185,6 +232,28 @@ SyscallResult Process::sys_create_server_socket(uint32_t backlog_limit) {
     return fd;
 }
 
+SyscallResult Process::sys_create_shared_memory(size_t size) {
+    if (size == 0 || size > VmObject::k_max_lazy_size) {
+        return Error::Invalid;
+    }
+    auto shared_memory = ustd::make_shared<SharedMemory>(size);
+    ScopedLock lock(m_lock);
+    uint32_t fd = allocate_fd();
+    m_fds[fd].emplace(shared_memory);
+    return fd;
+}
+
+SyscallResult Process::sys_create_thread(uintptr_t entry_point, uintptr_t arg, uintptr_t stack, uintptr_t tls_base) {
+    auto thread = create_thread(Thread::current().priority());
+    thread->register_state().rip = entry_point;
+    thread->register_state().rsp = stack;
+    thread->register_state().rdi = arg;
+    thread->set_tls_base(tls_base);
+    const auto tid = thread->tid();
+    Scheduler::insert_thread(ustd::move(thread));
+    return tid;
+}
+
 SyscallResult Process::sys_debug_line(const char *line) {
     dmesg("[#{}]: {}", m_pid, line);
     return 0;
@@ -208,10 +277,35 @@ SyscallResult Process::sys_exit(size_t code) {
     if (code != 0) {
         dmesg("[#{}]: sys_exit called with non-zero code {}", m_pid, code);
     }
+    Scheduler::kill_process(*this);
+    Scheduler::yield_and_kill();
+    return 0;
+}
+
+SyscallResult Process::sys_exit_thread() {
     Scheduler::yield_and_kill();
     return 0;
 }
 
+SyscallResult Process::sys_free_region(uintptr_t base, size_t size) {
+    return TRY(m_address_space->free({base, size}));
+}
+
+SyscallResult Process::sys_futex_wait(uint32_t *address, uint32_t expected, ssize_t timeout) {
+    // Spurious returns are allowed, so the caller must always recheck the futex word.
+    FramePin pin;
+    const auto phys = TRY(Futex::resolve(*m_address_space, reinterpret_cast<uintptr_t>(address), &pin));
+    if (!Thread::current().block<FutexBlocker>(phys, pin, expected, timeout)) {
+        return Error::Interrupted;
+    }
+    return 0;
+}
+
+SyscallResult Process::sys_futex_wake(uint32_t *address, size_t count) {
+    const auto phys = TRY(Futex::resolve(*m_address_space, reinterpret_cast<uintptr_t>(address)));
+    return Futex::wake(phys, count);
+}
+
 SyscallResult Process::sys_getcwd(char *path) {
     ScopedLock lock(m_lock);
     ustd::Vector<Inode *> inodes;
@@ -252,17 +346,65 @@ SyscallResult Process::sys_ioctl(uint32_t fd, ub_ioctl_request_t request, void *
     return m_fds[fd]->ioctl(request, arg);
 }
 
+SyscallResult Process::sys_join_thread(size_t tid) {
+    if (tid == Thread::current().tid()) {
+        return Error::Invalid;
+    }
+    if (!Thread::current().block<JoinBlocker>(*this, tid)) {
+        return Error::Interrupted;
+    }
+    return 0;
+}
+
 SyscallResult Process::sys_mkdir(const char *path) {
     ScopedLock lock(m_lock);
     return TRY(Vfs::mkdir(path, m_cwd));
 }
 
-SyscallResult Process::sys_mmap(uint32_t fd) {
+SyscallResult Process::sys_mmap(uint32_t fd, uintptr_t address, size_t size, ub_memory_prot_t prot,
+                               ub_mmap_flags_t flags, size_t offset) {
     ScopedLock lock(m_lock);
     if (fd >= m_fds.size() || !m_fds[fd]) {
         return Error::BadFd;
     }
-    return m_fds[fd]->mmap(*m_address_space);
+
+    auto vm_object_or_error = m_fds[fd]->file().vm_object();
+    if (vm_object_or_error.is_error()) {
+        // Device files map their whole memory themselves.
+        if (address != 0 || size != 0 || offset != 0) {
+            return Error::Invalid;
+        }
+        const auto base = m_fds[fd]->mmap(*m_address_space);
+        return base != 0 ? SyscallResult(base) : Error::Invalid;
+    }
+
+    auto vm_object = vm_object_or_error.disown_value();
+    const size_t object_size = vm_object->size();
+    if (address % 4_KiB != 0 || offset % 4_KiB != 0 || offset >= object_size) {
+        return Error::Invalid;
+    }
+    if (size == 0) {
+        size = object_size - offset;
+    }
+    if (size > VmObject::k_max_lazy_size) {
+        return Error::Invalid;
+    }
+    size = ustd::align_up(size, 4_KiB);
+
+    const auto access = region_access(prot);
+    const bool fixed = (flags & UB_MMAP_FLAG_FIXED) == UB_MMAP_FLAG_FIXED;
+    auto &region = fixed ? TRY(m_address_space->allocate_specific({address, size}, access))
+                         : TRY(m_address_space->allocate_anywhere(size, access));
+
+    // Shared mappings map the file's pages directly, whereas private mappings get a copy-on-write view of them, with
+    // anything past the end of the file being zero-filled.
+    if ((flags & UB_MMAP_FLAG_SHARED) == UB_MMAP_FLAG_SHARED) {
+        region.map_shared(ustd::move(vm_object), offset);
+    } else {
+        const size_t source_size = ustd::min(size, object_size - offset);
+        region.map(VmObject::create_shadow(ustd::move(vm_object), offset, source_size, size));
+    }
+    return region.base();
 }
 
 SyscallResult Process::sys_mount(const char *target, const char *fs_type) {
@@ -289,13 +431,25 @@ SyscallResult Process::sys_open(const char *path, ub_open_mode_t mode) {
 SyscallResult Process::sys_poll(ub_poll_fd_t *fds, size_t count, ssize_t timeout) {
     ustd::LargeVector<ub_poll_fd_t> poll_fds(count);
     __builtin_memcpy(poll_fds.data(), fds, count * sizeof(ub_poll_fd_t));
-    Thread::current().block<PollBlocker>(poll_fds, m_lock, *this, timeout);
-
     ScopedLock lock(m_lock);
+    for (const auto &poll_fd : poll_fds) {
+        if (file_handle(poll_fd.fd) == nullptr) {
+            return Error::BadFd;
+        }
+    }
+    lock.unlock();
+    if (!Thread::current().block<PollBlocker>(poll_fds, m_lock, *this, timeout)) {
+        return Error::Interrupted;
+    }
+
+    // A descriptor closed by another thread whilst we were waiting is reported with no events.
+    lock.relock(m_lock);
     for (auto &poll_fd : poll_fds) {
-        // TODO: Bounds checking.
-        auto &handle = m_fds[poll_fd.fd];
+        auto *handle = file_handle(poll_fd.fd);
         poll_fd.revents = static_cast<ub_poll_events_t>(0);
+        if (handle == nullptr) {
+            continue;
+        }
         if ((poll_fd.events & UB_POLL_EVENT_READ) == UB_POLL_EVENT_READ && !handle->read_would_block()) {
             poll_fd.revents |= UB_POLL_EVENT_READ;
         }
@@ -307,6 +461,10 @@ SyscallResult Process::sys_poll(ub_poll_fd_t *fds, size_t count, ssize_t timeout
     return 0;
 }
 
+SyscallResult Process::sys_protect_region(uintptr_t base, size_t size, ub_memory_prot_t prot) {
+    return TRY(m_address_space->protect({base, size}, region_access(prot)));
+}
+
 SyscallResult Process::sys_read(uint32_t fd, void *data, size_t size) {
     ScopedLock lock(m_lock);
     if (fd >= m_fds.size() || !m_fds[fd]) {
@@ -318,9 +476,18 @@ SyscallResult Process::sys_read(uint32_t fd, void *data, size_t size) {
         return Error::BrokenHandle;
     }
     if (handle->read_would_block()) {
+        // Keep the file alive and then look the descriptor up again afterwards, since another thread may close it
+        // whilst we wait.
+        ustd::SharedPtr<File> file(&handle->file());
+        const auto offset = handle->offset();
         lock.unlock();
-        Thread::current().block<ReadBlocker>(handle->file(), handle->offset());
+        if (!Thread::current().block<ReadBlocker>(*file, offset)) {
+            return Error::Interrupted;
+        }
         lock.relock(m_lock);
+        if (file_handle(fd) == nullptr) {
+            return Error::BadFd;
+        }
     }
     return TRY(m_fds[fd]->read(data, size));
 }
@@ -346,6 +513,102 @@ SyscallResult Process::sys_read_directory(const char *path, uint8_t *data) {
     return 0;
 }
 
+// Reads into each buffer in turn until one isn't filled, returning the total number of bytes read. As with read, the
+// file is only waited on once.
+SyscallResult Process::sys_readv(uint32_t fd, ub_iovec_t *iovecs, size_t count) {
+    ScopedLock lock(m_lock);
+    if (fd >= m_fds.size() || !m_fds[fd]) {
+        return Error::BadFd;
+    }
+    auto &handle = m_fds[fd];
+    if (!handle->valid()) {
+        handle.clear();
+        return Error::BrokenHandle;
+    }
+    if (handle->read_would_block()) {
+        // As with read, the descriptor may be closed by another thread whilst we wait.
+        ustd::SharedPtr<File> file(&handle->file());
+        const auto offset = handle->offset();
+        lock.unlock();
+        if (!Thread::current().block<ReadBlocker>(*file, offset)) {
+            return Error::Interrupted;
+        }
+        lock.relock(m_lock);
+        if (file_handle(fd) == nullptr) {
+            return Error::BadFd;
+        }
+    }
+
+    // An error after some bytes have been read is left for the next call to report.
+    size_t total_read = 0;
+    for (size_t i = 0; i < count; i++) {
+        auto bytes_read = m_fds[fd]->read(iovecs[i].data, iovecs[i].size);
+        if (bytes_read.is_error()) {
+            return total_read != 0 ? SyscallResult(total_read) : bytes_read.error();
+        }
+        total_read += bytes_read.value();
+        if (bytes_read.value() != iovecs[i].size) {
+            break;
+        }
+    }
+    return total_read;
+}
+
+SyscallResult Process::sys_receive_fd(uint32_t fd) {
+    ScopedLock lock(m_lock);
+    if (fd >= m_fds.size() || !m_fds[fd]) {
+        return Error::BadFd;
+    }
+    auto &file = m_fds[fd]->file();
+    if (!file.is_socket()) {
+        return Error::Invalid;
+    }
+    auto handle = static_cast<Socket &>(file).read_handles()->pop();
+    if (!handle) {
+        return Error::NonExistent;
+    }
+    uint32_t received_fd = allocate_fd();
+    m_fds[received_fd].emplace(ustd::move(*handle));
+    return received_fd;
+}
+
+SyscallResult Process::sys_receive_pages(uint32_t fd, size_t *size) {
+    ScopedLock lock(m_lock);
+    if (fd >= m_fds.size() || !m_fds[fd]) {
+        return Error::BadFd;
+    }
+    auto &file = m_fds[fd]->file();
+    if (!file.is_socket()) {
+        return Error::Invalid;
+    }
+    auto vm_object = static_cast<Socket &>(file).read_pages()->pop();
+    lock.unlock();
+    if (!vm_object) {
+        return Error::NonExistent;
+    }
+
+    const size_t vm_object_size = vm_object->size();
+    auto &region = TRY(m_address_space->allocate_anywhere(vm_object_size, region_access(UB_MEMORY_PROT_WRITE)));
+    region.map(ustd::move(vm_object));
+    if (size != nullptr) {
+        *size = vm_object_size;
+    }
+    return region.base();
+}
+
+// Rings each of the doorbells ring_fds and then polls, for a server replying to its clients and going back to waiting
+// on all of them. Unlike in call, failing to ring isn't an error, since a client may have gone away in the meantime,
+// which the poll reports anyway. Only the thread woken by the last ring is handed the CPU.
+SyscallResult Process::sys_reply_and_wait(const uint32_t *ring_fds, size_t ring_count, ub_poll_fd_t *fds, size_t count,
+                                          ssize_t timeout) {
+    for (size_t i = 0; i < ring_count; i++) {
+        static_cast<void>(ring_doorbell(ring_fds[i]));
+    }
+    const auto result = sys_poll(fds, count, timeout);
+    Scheduler::flush_handoff();
+    return result;
+}
+
 SyscallResult Process::sys_seek(uint32_t fd, size_t offset, ub_seek_mode_t mode) {
     ScopedLock lock(m_lock);
     if (fd >= m_fds.size() || !m_fds[fd]) {
@@ -358,6 +621,76 @@ SyscallResult Process::sys_seek(uint32_t fd, size_t offset, ub_seek_mode_t mode)
     return m_fds[fd]->seek(offset, mode);
 }
 
+SyscallResult Process::sys_send_fd(uint32_t fd, uint32_t sent_fd) {
+    ScopedLock lock(m_lock);
+    if (fd >= m_fds.size() || !m_fds[fd] || sent_fd >= m_fds.size() || !m_fds[sent_fd]) {
+        return Error::BadFd;
+    }
+    auto &file = m_fds[fd]->file();
+    if (!file.is_socket()) {
+        return Error::Invalid;
+    }
+    auto &socket = static_cast<Socket &>(file);
+    if (!socket.connected()) {
+        return Error::BrokenHandle;
+    }
+
+    // Sockets can't be sent, since a socket queued on itself would keep itself alive forever.
+    const auto &sent_file = m_fds[sent_fd]->file();
+    if (sent_file.is_socket() || sent_file.is_server_socket()) {
+        return Error::Invalid;
+    }
+    socket.write_handles()->push(FileHandle(*m_fds[sent_fd]));
+    return 0;
+}
+
+SyscallResult Process::sys_send_pages(uint32_t fd, uintptr_t base, size_t size) {
+    ScopedLock lock(m_lock);
+    if (fd >= m_fds.size() || !m_fds[fd]) {
+        return Error::BadFd;
+    }
+    auto &file = m_fds[fd]->file();
+    if (!file.is_socket()) {
+        return Error::Invalid;
+    }
+    ustd::SharedPtr<Socket> socket(&static_cast<Socket &>(file));
+    if (!socket->connected()) {
+        return Error::BrokenHandle;
+    }
+
+    // Release lock before touching the address space. The pages are moved out of it rather than copied, and the range
+    // is left unmapped.
+    lock.unlock();
+    socket->write_pages()->push(TRY(m_address_space->take({base, size})));
+    return 0;
+}
+
+SyscallResult Process::sys_set_priority(size_t pid, ub_priority_t priority) {
+    if (priority > UB_PRIORITY_REAL_TIME) {
+        return Error::Invalid;
+    }
+    auto process = Process::from_pid(pid);
+    if (!process) {
+        return Error::NonExistent;
+    }
+    if (process->is_kernel()) {
+        return Error::Invalid;
+    }
+
+    // Only our own priority and that of our children can be changed, and only by processes started by the kernel to
+    // real-time, since real-time threads can starve everything else.
+    const bool is_child = process->parent_pid() && *process->parent_pid() == m_pid;
+    if (process.ptr() != this && !is_child) {
+        return Error::Invalid;
+    }
+    if (priority == UB_PRIORITY_REAL_TIME && m_parent_pid) {
+        return Error::Invalid;
+    }
+    // The user visible classes are the same as the kernel's, minus Idle.
+    Scheduler::set_priority(*process, static_cast<ThreadPriority>(priority + 1));
+    return 0;
+}
+
 SyscallResult Process::sys_size(uint32_t fd) {
     ScopedLock lock(m_lock);
     if (fd >= m_fds.size() || !m_fds[fd]) {
@@ -379,7 +712,9 @@ SyscallResult Process::sys_virt_to_phys(uintptr_t virt) {
 }
 
 SyscallResult Process::sys_wait_pid(size_t pid) {
-    Thread::current().block<WaitBlocker>(pid);
+    if (!Thread::current().block<WaitBlocker>(pid)) {
+        return Error::Interrupted;
+    }
     return 0;
 }
 
@@ -394,11 +729,60 @@ SyscallResult Process::sys_write(uint32_t fd, void *data, size_t size) {
         return Error::BrokenHandle;
     }
     if (handle->write_would_block()) {
+        // The descriptor may be closed by another thread whilst we wait.
+        ustd::SharedPtr<File> file(&handle->file());
+        const auto offset = handle->offset();
         lock.unlock();
-        Thread::current().block<WriteBlocker>(handle->file(), handle->offset());
+        if (!Thread::current().block<WriteBlocker>(*file, offset)) {
+            return Error::Interrupted;
+        }
         lock.relock(m_lock);
+        if (file_handle(fd) == nullptr) {
+            return Error::BadFd;
+        }
     }
     return TRY(m_fds[fd]->write(data, size));
 }
 
+// Writes each buffer in turn until one isn't written in full, returning the total number of bytes written, so that
+// several buffers can go out in a single syscall. As with write, the file is only waited on once.
+SyscallResult Process::sys_writev(uint32_t fd, ub_iovec_t *iovecs, size_t count) {
+    ScopedLock lock(m_lock);
+    if (fd >= m_fds.size() || !m_fds[fd]) {
+        return Error::BadFd;
+    }
+    auto &handle = m_fds[fd];
+    if (!handle->valid()) {
+        handle.clear();
+        return Error::BrokenHandle;
+    }
+    if (handle->write_would_block()) {
+        // As with write, the descriptor may be closed by another thread whilst we wait.
+        ustd::SharedPtr<File> file(&handle->file());
+        const auto offset = handle->offset();
+        lock.unlock();
+        if (!Thread::current().block<WriteBlocker>(*file, offset)) {
+            return Error::Interrupted;
+        }
+        lock.relock(m_lock);
+        if (file_handle(fd) == nullptr) {
+            return Error::BadFd;
+        }
+    }
+
+    // An error after some bytes have been written is left for the next call to report.
+    size_t total_written = 0;
+    for (size_t i = 0; i < count; i++) {
+        auto bytes_written = m_fds[fd]->write(iovecs[i].data, iovecs[i].size);
+        if (bytes_written.is_error()) {
+            return total_written != 0 ? SyscallResult(total_written) : bytes_written.error();
+        }
+        total_written += bytes_written.value();
+        if (bytes_written.value() != iovecs[i].size) {
+            break;
+        }
+    }
+    return total_written;
+}
+
 } // namespace kernel
@@ -44,15 +44,13 @@ void Hpet::spin(uint64_t millis) const {
 
 uint64_t Hpet::update_time() {
     uint64_t current_count = read_counter();
-    uint64_t delta_count = 0;
-    if (current_count >= m_previous_count) {
-        delta_count = current_count - m_previous_count;
-    } else {
-        delta_count = m_previous_count - current_count;
-        if (!m_64_bit) {
-            m_32_bit_wraps++;
-        }
+    if (current_count < m_previous_count) {
+        // Only a 32-bit counter can have wrapped since the last update.
+        ASSERT(!m_64_bit);
+        m_32_bit_wraps++;
+        current_count += 1ul << 32u;
     }
+    const uint64_t delta_count = current_count - m_previous_count;
     m_previous_count = current_count;
     return (delta_count * m_period) / 1000000ul;
 }
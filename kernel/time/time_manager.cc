@@ -2,15 +2,67 @@
 
 #include <kernel/acpi/generic_address.hh>
 #include <kernel/acpi/hpet_table.hh>
+#include <kernel/api/types.h>
+#include <kernel/arch/cpu.hh>
+#include <kernel/dmesg.hh>
+#include <kernel/mem/physical_page.hh>
+#include <kernel/mem/vm_object.hh>
+#include <kernel/scoped_lock.hh>
+#include <kernel/spin_lock.hh>
 #include <kernel/time/hpet.hh>
 #include <ustd/assert.hh>
+#include <ustd/atomic.hh>
+#include <ustd/numeric.hh>
+#include <ustd/shared_ptr.hh>
 #include <ustd/types.hh>
 
 namespace kernel {
 namespace {
 
+// TSC ticks are converted to nanoseconds as (ticks * tsc_scale) >> k_tsc_shift. Each CPU then adds its own offset,
+// which lines its TSC up with the HPET. The offsets rely on unsigned wraparound, since a TSC may have been counting for
+// longer than the HPET.
+constexpr uint32_t k_tsc_shift = 32;
+static_assert(sizeof(ub_time_page_t::tsc_offsets) / sizeof(uint64_t) == arch::k_max_cpu_count);
+
+// The number of times the HPET is sampled when synchronising a CPU.
+constexpr size_t k_sync_sample_count = 16;
+
 Hpet *s_hpet;
-uint64_t s_ns_since_boot = 0;
+uint64_t s_hpet_ns = 0;
+SpinLock s_hpet_lock;
+bool s_tsc_enabled = false;
+
+// The latest time returned by ns_since_boot, which is never allowed to go backwards, even when called on a CPU whose
+// offset is slightly behind that of another.
+ustd::Atomic<uint64_t> s_last_ns;
+
+// The TSC parameters live in the time page so that user processes can read the time without a syscall. Writers must
+// hold s_time_page_lock and bump the sequence number before and after changing anything.
+ustd::SharedPtr<VmObject> s_time_page_object;
+volatile ub_time_page_t *s_time_page = nullptr;
+SpinLock s_time_page_lock;
+
+uint64_t hpet_ns() {
+    ScopedLock locker(s_hpet_lock);
+    s_hpet_ns += s_hpet->update_time();
+    return s_hpet_ns;
+}
+
+uint64_t tsc_ns() {
+    const auto ticks = static_cast<unsigned __int128>(arch::read_cycle_counter());
+    return static_cast<uint64_t>((ticks * s_time_page->tsc_scale) >> k_tsc_shift);
+}
+
+void begin_time_page_write() {
+    s_time_page->sequence = s_time_page->sequence + 1;
+    ustd::atomic_thread_fence(ustd::memory_order_release);
+}
+
+void end_time_page_write() {
+    ustd::atomic_thread_fence(ustd::memory_order_release);
+    s_time_page->sequence = s_time_page->sequence + 1;
+}
 
 } // namespace
 
@@ -23,18 +75,71 @@ void TimeManager::initialise(const acpi::HpetTable *hpet_table) {
     // Enable the main counter.
     s_hpet = new Hpet(hpet_address.address);
     s_hpet->enable();
+
+    // Allocate the time page, which stays zeroed (meaning no TSC) unless enable_tsc is called.
+    s_time_page_object = VmObject::create(4_KiB);
+    auto *time_page = reinterpret_cast<ub_time_page_t *>(s_time_page_object->physical_pages()[0].phys());
+    __builtin_memset(time_page, 0, sizeof(ub_time_page_t));
+    s_time_page = time_page;
+}
+
+void TimeManager::enable_tsc(uint64_t ticks_in_one_ms) {
+    {
+        ScopedLock locker(s_time_page_lock);
+        begin_time_page_write();
+        s_time_page->tsc_shift = k_tsc_shift;
+        s_time_page->tsc_scale = (1000000ul << k_tsc_shift) / ticks_in_one_ms;
+        end_time_page_write();
+    }
+    s_tsc_enabled = true;
+    synchronise_cpu();
+    dmesg("time: Using TSC as clocksource ({} ticks/ms)", ticks_in_one_ms);
+}
+
+void TimeManager::synchronise_cpu() {
+    if (!s_tsc_enabled) {
+        return;
+    }
+
+    // Compare the HPET against the midpoint of two TSC reads either side of it, which halves the error from the slow
+    // MMIO read. The error is at most half the time between the two reads, so keep the tightest of several samples.
+    uint64_t best_window = ~uint64_t(0);
+    uint64_t offset = 0;
+    for (size_t i = 0; i < k_sync_sample_count; i++) {
+        const auto before = tsc_ns();
+        const auto hpet = hpet_ns();
+        const auto after = tsc_ns();
+        if (after - before < best_window) {
+            best_window = after - before;
+            offset = hpet - (before + (after - before) / 2);
+        }
+    }
+    ScopedLock locker(s_time_page_lock);
+    begin_time_page_write();
+    s_time_page->tsc_offsets[arch::current_cpu()] = offset;
+    end_time_page_write();
 }
 
 void TimeManager::spin(uint64_t millis) {
     s_hpet->spin(millis);
 }
 
-void TimeManager::update() {
-    s_ns_since_boot += s_hpet->update_time();
+uint64_t TimeManager::ns_since_boot() {
+    if (!s_tsc_enabled) {
+        return hpet_ns();
+    }
+
+    // The offsets are only as good as their sampling error, so clamp to the latest time returned on any CPU to keep time
+    // monotonic across them.
+    const uint64_t ns = tsc_ns() + s_time_page->tsc_offsets[arch::current_cpu()];
+    uint64_t last = s_last_ns.load();
+    while (ns > last && !s_last_ns.compare_exchange(last, ns)) {
+    }
+    return ustd::max(ns, last);
 }
 
-uint64_t TimeManager::ns_since_boot() {
-    return s_ns_since_boot;
+ustd::SharedPtr<VmObject> TimeManager::time_page() {
+    return s_time_page_object;
 }
 
 } // namespace kernel
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <ustd/shared_ptr.hh>
 #include <ustd/types.hh>
 
 namespace kernel::acpi {
@@ -10,11 +11,15 @@ class HpetTable;
 
 namespace kernel {
 
+class VmObject;
+
 struct TimeManager {
     static void initialise(const acpi::HpetTable *hpet_table);
+    static void enable_tsc(uint64_t ticks_in_one_ms);
+    static void synchronise_cpu();
     static void spin(uint64_t millis);
-    static void update();
     static uint64_t ns_since_boot();
+    static ustd::SharedPtr<VmObject> time_page();
 };
 
 } // namespace kernel
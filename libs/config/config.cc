@@ -59,19 +59,16 @@ void read(ustd::StringView domain) {
 }
 
 ustd::Vector<ustd::String> list_all() {
-    client().send_message<ListAllMessage>();
-    auto response = client().wait_message<ListAllResponseMessage>();
+    auto response = client().call<ListAllResponseMessage, ListAllMessage>();
     return ustd::move(response.list());
 }
 
 ustd::Optional<ustd::String> lookup(ustd::StringView domain, ustd::StringView key) {
-    client().send_message<LookupMessage>(domain, key);
-    return client().wait_message<LookupResponseMessage>().value();
+    return client().call<LookupResponseMessage, LookupMessage>(domain, key).value();
 }
 
 bool update(ustd::StringView domain, ustd::StringView key, ustd::StringView value) {
-    client().send_message<UpdateMessage>(domain, key, value);
-    return client().wait_message<UpdateResponseMessage>().success();
+    return client().call<UpdateResponseMessage, UpdateMessage>(domain, key, value).success();
 }
 
 void watch(ustd::StringView domain, ustd::StringView key, ustd::Function<void(ustd::StringView)> callback) {
@@ -22,8 +22,7 @@ ipc::Client *client() {
 } // namespace
 
 TerminalSize terminal_size() {
-    client()->send_message<GetTerminalSize>();
-    auto response = client()->wait_message<GetTerminalSizeRespone>();
+    auto response = client()->call<GetTerminalSizeRespone, GetTerminalSize>();
     return {response.column_count(), response.row_count()};
 }
 
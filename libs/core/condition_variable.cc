@@ -0,0 +1,27 @@
+#include <core/condition_variable.hh>
+
+#include <core/futex.hh>
+#include <core/mutex.hh>
+#include <ustd/atomic.hh>
+#include <ustd/types.hh>
+
+namespace core {
+
+void ConditionVariable::wait(Mutex &mutex) {
+    const auto sequence = m_sequence.load(ustd::memory_order_relaxed);
+    mutex.unlock();
+    static_cast<void>(futex_wait(m_sequence, sequence));
+    mutex.lock();
+}
+
+void ConditionVariable::notify_one() {
+    m_sequence.fetch_add(1, ustd::memory_order_release);
+    futex_wake(m_sequence, 1);
+}
+
+void ConditionVariable::notify_all() {
+    m_sequence.fetch_add(1, ustd::memory_order_release);
+    futex_wake(m_sequence, ~0ul);
+}
+
+} // namespace core
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <ustd/atomic.hh>
+#include <ustd/types.hh>
+
+namespace core {
+
+class Mutex;
+
+// A condition variable for use with core::Mutex. Waiters may wake spuriously, so they must recheck their condition.
+class ConditionVariable {
+    // Bumped by every notify, so that a waiter which is notified between unlocking the mutex and sleeping doesn't
+    // sleep at all.
+    ustd::Atomic<uint32_t> m_sequence{0};
+
+public:
+    void wait(Mutex &mutex);
+    void notify_one();
+    void notify_all();
+};
+
+} // namespace core
@@ -24,6 +24,7 @@ ustd::Array k_error_list{
     "not a directory",
     "already exists",
     "resource busy",
+    "interrupted",
 };
 // clang-format on
 
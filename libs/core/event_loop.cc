@@ -1,6 +1,7 @@
 #include <core/event_loop.hh>
 
 #include <core/error.hh>
+#include <core/time.hh>
 #include <core/timer.hh>
 #include <core/watchable.hh>
 #include <log/log.hh>
@@ -32,21 +33,49 @@ uint32_t EventLoop::index_of(Watchable *watchable) {
     ENSURE_NOT_REACHED();
 }
 
-ssize_t EventLoop::next_timer_deadline() {
-    ssize_t deadline = -1;
+ssize_t EventLoop::next_timer_timeout() const {
+    // Returns the time until the nearest timer fires, or -1 to wait forever if there are no timers.
+    if (m_timers.empty()) {
+        return -1;
+    }
+    const auto now = core::time();
+    ssize_t timeout = -1;
     for (auto *timer : m_timers) {
-        const auto period = static_cast<ssize_t>(timer->period());
-        if (deadline == -1 || period < deadline) {
-            deadline = period;
+        const auto remaining = static_cast<ssize_t>(timer->m_fire_time > now ? timer->m_fire_time - now : 0);
+        if (timeout == -1 || remaining < timeout) {
+            timeout = remaining;
+        }
+    }
+    return timeout;
+}
+
+// Drops a ring queued with ring_on_poll, which must be done before the doorbell is closed, since its descriptor could
+// otherwise be reused by the time of the next poll.
+void EventLoop::cancel_ring(uint32_t doorbell_fd) {
+    for (uint32_t i = 0; i < m_reply_doorbells.size(); i++) {
+        if (m_reply_doorbells[i] == doorbell_fd) {
+            m_reply_doorbells.remove(i);
+            return;
         }
     }
-    return deadline;
 }
 
 void EventLoop::register_timer(Timer &timer) {
     m_timers.push(&timer);
 }
 
+// Rings the given doorbell as part of the next poll, so that a peer waiting on a reply gets woken as we go back to
+// sleep, without a syscall of its own. However many replies go out to however many peers in an iteration of the loop,
+// only the poll itself is a syscall.
+void EventLoop::ring_on_poll(uint32_t doorbell_fd) {
+    for (auto fd : m_reply_doorbells) {
+        if (fd == doorbell_fd) {
+            return;
+        }
+    }
+    m_reply_doorbells.push(doorbell_fd);
+}
+
 void EventLoop::unregister_timer(Timer &timer) {
     m_timers.remove(index_of(&timer));
 }
@@ -67,12 +96,17 @@ void EventLoop::unwatch(Watchable &watchable) {
 
 size_t EventLoop::run() {
     while (true) {
-        const auto timeout = next_timer_deadline();
-        if (auto rc = system::syscall(UB_SYS_poll, m_poll_fds.data(), m_poll_fds.size(), timeout); rc.is_error()) {
+        const auto timeout = next_timer_timeout();
+        auto rc = !m_reply_doorbells.empty()
+                      ? system::syscall(UB_SYS_reply_and_wait, m_reply_doorbells.data(), m_reply_doorbells.size(),
+                                        m_poll_fds.data(), m_poll_fds.size(), timeout)
+                      : system::syscall(UB_SYS_poll, m_poll_fds.data(), m_poll_fds.size(), timeout);
+        m_reply_doorbells.clear();
+        if (rc.is_error()) {
             log::error("poll: {}", core::error_string(rc.error()));
             return 1;
         }
-        auto now = EXPECT(system::syscall<size_t>(UB_SYS_gettime));
+        auto now = core::time();
         for (auto *timer : m_timers) {
             if (!timer->has_expired(now)) {
                 continue;
@@ -13,13 +13,16 @@ class EventLoop {
     ustd::Vector<ub_poll_fd_t> m_poll_fds;
     ustd::Vector<Timer *> m_timers;
     ustd::Vector<Watchable *> m_watchables;
+    ustd::Vector<uint32_t> m_reply_doorbells;
 
     uint32_t index_of(Timer *timer);
     uint32_t index_of(Watchable *watchable);
-    ssize_t next_timer_deadline();
+    ssize_t next_timer_timeout() const;
 
 public:
+    void cancel_ring(uint32_t doorbell_fd);
     void register_timer(Timer &timer);
+    void ring_on_poll(uint32_t doorbell_fd);
     void unregister_timer(Timer &timer);
     void watch(Watchable &watchable, ub_poll_events_t events);
     void unwatch(Watchable &watchable);
@@ -29,8 +29,11 @@ ustd::Result<size_t, ub_error_t> File::ioctl(ub_ioctl_request_t request, void *a
     return TRY(system::syscall(UB_SYS_ioctl, *m_fd, request, arg));
 }
 
-ustd::Result<uintptr_t, ub_error_t> File::mmap() {
-    return TRY(system::syscall(UB_SYS_mmap, *m_fd));
+// Maps size bytes of the file starting at offset, or the rest of the file if size is zero. Device files only support
+// mapping their whole memory, with the default arguments.
+ustd::Result<uintptr_t, ub_error_t> File::mmap(size_t offset, size_t size, ub_memory_prot_t prot,
+                                               ub_mmap_flags_t flags, uintptr_t address) {
+    return TRY(system::syscall(UB_SYS_mmap, *m_fd, address, size, prot, flags, offset));
 }
 
 ustd::Result<size_t, ub_error_t> File::read(ustd::Span<void> data) {
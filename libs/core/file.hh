@@ -34,7 +34,9 @@ public:
 
     void close();
     ustd::Result<size_t, ub_error_t> ioctl(ub_ioctl_request_t request, void *arg = nullptr);
-    ustd::Result<uintptr_t, ub_error_t> mmap();
+    ustd::Result<uintptr_t, ub_error_t> mmap(size_t offset = 0, size_t size = 0,
+                                             ub_memory_prot_t prot = UB_MEMORY_PROT_NONE,
+                                             ub_mmap_flags_t flags = UB_MMAP_FLAG_NONE, uintptr_t address = 0);
     ustd::Result<size_t, ub_error_t> read(ustd::Span<void> data);
     ustd::Result<size_t, ub_error_t> read(ustd::Span<void> data, size_t offset);
     ustd::Result<void, ub_error_t> rebind(uint32_t fd);
@@ -42,7 +44,9 @@ public:
     ustd::Result<size_t, ub_error_t> write(ustd::Span<const void> data);
 
     template <typename T>
-    ustd::Result<T *, ub_error_t> mmap();
+    ustd::Result<T *, ub_error_t> mmap(size_t offset = 0, size_t size = 0,
+                                       ub_memory_prot_t prot = UB_MEMORY_PROT_NONE,
+                                       ub_mmap_flags_t flags = UB_MMAP_FLAG_NONE, uintptr_t address = 0);
     template <typename T>
     ustd::Result<T, ub_error_t> read();
     template <typename T>
@@ -52,8 +56,9 @@ public:
 };
 
 template <typename T>
-ustd::Result<T *, ub_error_t> File::mmap() {
-    return reinterpret_cast<T *>(TRY(mmap()));
+ustd::Result<T *, ub_error_t> File::mmap(size_t offset, size_t size, ub_memory_prot_t prot, ub_mmap_flags_t flags,
+                                         uintptr_t address) {
+    return reinterpret_cast<T *>(TRY(mmap(offset, size, prot, flags, address)));
 }
 
 template <typename T>
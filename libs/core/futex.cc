@@ -0,0 +1,21 @@
+#include <core/futex.hh>
+
+#include <system/syscall.hh>
+#include <system/system.h>
+#include <ustd/atomic.hh>
+#include <ustd/result.hh>
+#include <ustd/try.hh>
+#include <ustd/types.hh>
+
+namespace core {
+
+ustd::Result<void, ub_error_t> futex_wait(ustd::Atomic<uint32_t> &word, uint32_t expected, ssize_t timeout) {
+    TRY(system::syscall(UB_SYS_futex_wait, &word, expected, timeout));
+    return {};
+}
+
+size_t futex_wake(ustd::Atomic<uint32_t> &word, size_t count) {
+    return EXPECT(system::syscall(UB_SYS_futex_wake, &word, count));
+}
+
+} // namespace core
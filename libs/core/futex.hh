@@ -0,0 +1,17 @@
+#pragma once
+
+#include <system/error.h>
+#include <ustd/atomic.hh>
+#include <ustd/result.hh>
+#include <ustd/types.hh>
+
+namespace core {
+
+// Sleeps until woken by futex_wake, as long as the word still holds the expected value. A negative timeout means to
+// wait forever. Spurious wakeups are possible, so callers must always recheck the word.
+ustd::Result<void, ub_error_t> futex_wait(ustd::Atomic<uint32_t> &word, uint32_t expected, ssize_t timeout = -1);
+
+// Wakes up to count threads waiting on the word, returning the number woken.
+size_t futex_wake(ustd::Atomic<uint32_t> &word, size_t count);
+
+} // namespace core
@@ -1,17 +1,25 @@
+#include <ustd/atomic.hh>
 #include <ustd/numeric.hh>
 #include <ustd/types.hh>
 
 namespace {
 
-uintptr_t s_pos = 6_TiB;
+// Bumped atomically since any thread may allocate.
+ustd::Atomic<uintptr_t> s_pos(6_TiB);
+
+void *allocate(size_t size, size_t alignment) {
+    auto pos = s_pos.load(ustd::memory_order_relaxed);
+    uintptr_t base;
+    do {
+        base = ustd::align_up(pos, alignment);
+    } while (!s_pos.compare_exchange(pos, base + size, ustd::memory_order_relaxed));
+    return reinterpret_cast<void *>(base);
+}
 
 } // namespace
 
 void *operator new(size_t size) {
-    s_pos = ustd::align_up(s_pos, 16);
-    auto *ret = reinterpret_cast<void *>(s_pos);
-    s_pos += size;
-    return ret;
+    return allocate(size, 16);
 }
 
 void *operator new[](size_t size) {
@@ -19,10 +27,7 @@ void *operator new[](size_t size) {
 }
 
 void *operator new(size_t size, ustd::align_val_t align) {
-    s_pos = ustd::align_up(s_pos, static_cast<size_t>(align));
-    auto *ret = reinterpret_cast<void *>(s_pos);
-    s_pos += size;
-    return ret;
+    return allocate(size, static_cast<size_t>(align));
 }
 
 void *operator new[](size_t size, ustd::align_val_t align) {
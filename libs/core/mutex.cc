@@ -0,0 +1,35 @@
+#include <core/mutex.hh>
+
+#include <core/futex.hh>
+#include <ustd/atomic.hh>
+#include <ustd/types.hh>
+
+namespace core {
+
+void Mutex::lock() {
+    uint32_t state = 0;
+    if (m_state.compare_exchange(state, 1, ustd::memory_order_acquire)) {
+        return;
+    }
+
+    // Mark the mutex as contended before sleeping, so that the unlocker knows to wake us.
+    if (state != 2) {
+        state = m_state.exchange(2, ustd::memory_order_acquire);
+    }
+    while (state != 0) {
+        static_cast<void>(futex_wait(m_state, 2));
+        state = m_state.exchange(2, ustd::memory_order_acquire);
+    }
+}
+
+bool Mutex::try_lock() {
+    return m_state.cmpxchg(0, 1, ustd::memory_order_acquire);
+}
+
+void Mutex::unlock() {
+    if (m_state.exchange(0, ustd::memory_order_release) == 2) {
+        futex_wake(m_state, 1);
+    }
+}
+
+} // namespace core
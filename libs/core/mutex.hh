@@ -0,0 +1,19 @@
+#pragma once
+
+#include <ustd/atomic.hh>
+#include <ustd/types.hh>
+
+namespace core {
+
+// A mutex which only makes a syscall when contended.
+class Mutex {
+    // Zero when unlocked, one when locked and two when locked with possible waiters.
+    ustd::Atomic<uint32_t> m_state{0};
+
+public:
+    void lock();
+    bool try_lock();
+    void unlock();
+};
+
+} // namespace core
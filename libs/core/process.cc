@@ -51,6 +51,11 @@ size_t pid() {
     return EXPECT(system::syscall(UB_SYS_getpid));
 }
 
+ustd::Result<void, ub_error_t> set_priority(size_t pid, ub_priority_t priority) {
+    TRY(system::syscall(UB_SYS_set_priority, pid, priority));
+    return {};
+}
+
 ustd::Result<void, ub_error_t> wait_pid(size_t pid) {
     TRY(system::syscall(UB_SYS_wait_pid, pid));
     return {};
@@ -18,6 +18,7 @@ ustd::Result<size_t, ub_error_t> create_process(const char *path, ustd::Vector<c
 
 ustd::String cwd();
 size_t pid();
+ustd::Result<void, ub_error_t> set_priority(size_t pid, ub_priority_t priority);
 ustd::Result<void, ub_error_t> wait_pid(size_t pid);
 
 } // namespace core
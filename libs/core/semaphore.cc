@@ -0,0 +1,36 @@
+#include <core/semaphore.hh>
+
+#include <core/futex.hh>
+#include <ustd/atomic.hh>
+#include <ustd/types.hh>
+
+namespace core {
+
+void Semaphore::acquire() {
+    while (!try_acquire()) {
+        // Registering as a waiter before sleeping means that a release after this point will wake us, and a release
+        // before it will have made the count non-zero, which the futex notices.
+        m_waiter_count.fetch_add(1, ustd::memory_order_seq_cst);
+        static_cast<void>(futex_wait(m_count, 0));
+        m_waiter_count.fetch_sub(1, ustd::memory_order_relaxed);
+    }
+}
+
+bool Semaphore::try_acquire() {
+    auto count = m_count.load(ustd::memory_order_relaxed);
+    while (count != 0) {
+        if (m_count.compare_exchange(count, count - 1, ustd::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Semaphore::release() {
+    m_count.fetch_add(1, ustd::memory_order_seq_cst);
+    if (m_waiter_count.load(ustd::memory_order_seq_cst) != 0) {
+        futex_wake(m_count, 1);
+    }
+}
+
+} // namespace core
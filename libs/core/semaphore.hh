@@ -0,0 +1,21 @@
+#pragma once
+
+#include <ustd/atomic.hh>
+#include <ustd/types.hh>
+
+namespace core {
+
+// A counting semaphore which only makes a syscall when a thread has to wait, or when there are waiters to wake.
+class Semaphore {
+    ustd::Atomic<uint32_t> m_count;
+    ustd::Atomic<uint32_t> m_waiter_count{0};
+
+public:
+    explicit Semaphore(uint32_t count) : m_count(count) {}
+
+    void acquire();
+    bool try_acquire();
+    void release();
+};
+
+} // namespace core
@@ -0,0 +1,55 @@
+#include <core/thread.hh>
+
+#include <system/syscall.hh>
+#include <system/system.h>
+#include <ustd/assert.hh>
+#include <ustd/function.hh>
+#include <ustd/result.hh>
+#include <ustd/try.hh>
+#include <ustd/types.hh>
+#include <ustd/utility.hh>
+
+namespace core {
+
+struct Thread::ControlBlock {
+    ControlBlock *self{this};
+    ustd::Function<void()> function;
+    uint8_t *stack;
+    size_t stack_size;
+};
+
+void Thread::entry(ControlBlock *control_block) {
+    control_block->function();
+    EXPECT(system::syscall(UB_SYS_exit_thread));
+    ENSURE_NOT_REACHED();
+}
+
+Thread::Thread(ustd::Function<void()> function, size_t stack_size)
+    : m_control_block(new ControlBlock{.function = ustd::move(function), .stack = nullptr, .stack_size = stack_size}) {
+    m_control_block->stack = EXPECT(system::syscall<uint8_t *>(UB_SYS_allocate_region, stack_size,
+                                                                UB_MEMORY_PROT_WRITE));
+
+    // Leave a null return address at the top of the stack, so that the stack is aligned as if entry had been called.
+    auto *stack_top = reinterpret_cast<uintptr_t *>(m_control_block->stack + stack_size) - 1;
+    *stack_top = 0;
+    m_tid = EXPECT(system::syscall(UB_SYS_create_thread, &entry, m_control_block, stack_top, m_control_block));
+}
+
+Thread::Thread(Thread &&other)
+    : m_control_block(ustd::exchange(other.m_control_block, nullptr)), m_tid(other.m_tid) {}
+
+Thread::~Thread() {
+    if (m_control_block != nullptr) {
+        EXPECT(join());
+    }
+}
+
+ustd::Result<void, ub_error_t> Thread::join() {
+    ASSERT(m_control_block != nullptr);
+    TRY(system::syscall(UB_SYS_join_thread, m_tid));
+    EXPECT(system::syscall(UB_SYS_free_region, m_control_block->stack, m_control_block->stack_size));
+    delete ustd::exchange(m_control_block, nullptr);
+    return {};
+}
+
+} // namespace core
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <system/error.h>
+#include <ustd/function.hh>
+#include <ustd/result.hh>
+#include <ustd/types.hh>
+
+namespace core {
+
+// A thread in the current process, running on its own stack. The thread's FS base points to a control block whose
+// first word points to itself, as with the usual x86-64 TLS layout. A thread which hasn't been joined is joined when
+// destroyed.
+class Thread {
+    struct ControlBlock;
+    ControlBlock *m_control_block;
+    size_t m_tid;
+
+    [[noreturn]] static void entry(ControlBlock *control_block);
+
+public:
+    explicit Thread(ustd::Function<void()> function, size_t stack_size = 64_KiB);
+    Thread(const Thread &) = delete;
+    Thread(Thread &&other);
+    ~Thread();
+
+    Thread &operator=(const Thread &) = delete;
+    Thread &operator=(Thread &&) = delete;
+
+    ustd::Result<void, ub_error_t> join();
+
+    size_t tid() const { return m_tid; }
+};
+
+} // namespace core
@@ -1,17 +1,56 @@
 #include <core/time.hh>
 
 #include <system/syscall.hh>
+#include <system/system.h>
+#include <ustd/atomic.hh>
+#include <ustd/numeric.hh>
 #include <ustd/try.hh>
 #include <ustd/types.hh>
 
 namespace core {
+namespace {
+
+// The latest time returned in this process. The kernel's per-CPU TSC offsets are only as good as their sampling error,
+// so a thread moving between CPUs could otherwise see time go backwards, as the kernel itself would without its own
+// clamp in TimeManager::ns_since_boot.
+ustd::Atomic<size_t> s_last_time;
+
+size_t clamp_monotonic(size_t ns) {
+    size_t last = s_last_time.load(ustd::memory_order_relaxed);
+    while (ns > last && !s_last_time.compare_exchange(last, ns, ustd::memory_order_relaxed)) {
+    }
+    return ustd::max(ns, last);
+}
+
+} // namespace
 
 void sleep(size_t ns) {
     EXPECT(system::syscall(UB_SYS_poll, nullptr, 0, ns));
 }
 
 size_t time() {
-    return EXPECT(system::syscall(UB_SYS_gettime));
+    // Read the time from the kernel's time page, retrying if the kernel was updating it at the same time.
+    const auto *page = reinterpret_cast<const volatile ub_time_page_t *>(UB_TIME_PAGE_ADDRESS);
+    while (true) {
+        const uint32_t sequence = page->sequence;
+        ustd::atomic_thread_fence(ustd::memory_order_acquire);
+        if (page->tsc_scale == 0) {
+            return EXPECT(system::syscall(UB_SYS_gettime));
+        }
+
+        uint32_t low;
+        uint32_t high;
+        uint32_t cpu;
+        asm volatile("rdtscp" : "=a"(low), "=d"(high), "=c"(cpu));
+        const auto ticks = (static_cast<uint64_t>(high) << 32u) | low;
+        const auto scaled = (static_cast<unsigned __int128>(ticks) * page->tsc_scale) >> page->tsc_shift;
+        const auto ns = static_cast<size_t>(scaled) + page->tsc_offsets[cpu];
+
+        ustd::atomic_thread_fence(ustd::memory_order_acquire);
+        if ((sequence & 1u) == 0u && page->sequence == sequence) {
+            return clamp_monotonic(ns);
+        }
+    }
 }
 
 } // namespace core
@@ -0,0 +1,252 @@
+#include <ipc/channel.hh>
+
+#include <core/event_loop.hh>
+#include <core/file.hh>
+#include <core/futex.hh>
+#include <system/syscall.hh>
+#include <ustd/array.hh>
+#include <ustd/assert.hh>
+#include <ustd/atomic.hh>
+#include <ustd/numeric.hh>
+#include <ustd/optional.hh>
+#include <ustd/result.hh>
+#include <ustd/span.hh>
+#include <ustd/try.hh>
+#include <ustd/types.hh>
+#include <ustd/utility.hh>
+
+namespace ipc {
+namespace {
+
+// Room for a few of the largest messages that Client sends.
+constexpr uint32_t k_ring_capacity = 32_KiB;
+
+// How long a sender waiting for room sleeps before checking that the peer is still there, in nanoseconds.
+constexpr ssize_t k_room_wait_timeout = 1000000000;
+
+} // namespace
+
+// The head and tail are free-running positions which are only written by the receiving and the sending side
+// respectively, and which are kept on separate cache lines so that the two sides don't contend over them. The head
+// doubles as a futex for the sending side to wait on when the ring is full, in which case it sets sender_waiting.
+struct ChannelRing {
+    alignas(64) ustd::Atomic<uint32_t> head;
+    alignas(64) ustd::Atomic<uint32_t> tail;
+    ustd::Atomic<uint32_t> sender_waiting;
+    alignas(64) ustd::Array<uint8_t, k_ring_capacity> data;
+
+    void copy_in(uint32_t position, const void *source, uint32_t size);
+    void copy_out(uint32_t position, void *dest, uint32_t size) const;
+};
+
+namespace {
+
+constexpr size_t k_memory_size = ustd::align_up(2 * sizeof(ChannelRing), 4_KiB);
+
+ustd::Result<core::File, ub_error_t> receive_fd(uint32_t socket_fd) {
+    return core::File(TRY(system::syscall<uint32_t>(UB_SYS_receive_fd, socket_fd)));
+}
+
+} // namespace
+
+void ChannelRing::copy_in(uint32_t position, const void *source, uint32_t size) {
+    const uint32_t offset = position & (k_ring_capacity - 1);
+    const uint32_t first_size = ustd::min(size, k_ring_capacity - offset);
+    __builtin_memcpy(data.data() + offset, source, first_size);
+    __builtin_memcpy(data.data(), static_cast<const uint8_t *>(source) + first_size, size - first_size);
+}
+
+void ChannelRing::copy_out(uint32_t position, void *dest, uint32_t size) const {
+    const uint32_t offset = position & (k_ring_capacity - 1);
+    const uint32_t first_size = ustd::min(size, k_ring_capacity - offset);
+    __builtin_memcpy(dest, data.data() + offset, first_size);
+    __builtin_memcpy(static_cast<uint8_t *>(dest) + first_size, data.data(), size - first_size);
+}
+
+// Sets up a channel over the given socket for the peer to accept, sending it the shared memory and the doorbells.
+ustd::Result<Channel, ub_error_t> Channel::create(uint32_t socket_fd) {
+    ustd::Array<uint32_t, 2> doorbell_fds{};
+    TRY(system::syscall(UB_SYS_create_doorbell, doorbell_fds.data()));
+    core::File wait_end(doorbell_fds[0]);
+    core::File ring_end(doorbell_fds[1]);
+    TRY(system::syscall(UB_SYS_create_doorbell, doorbell_fds.data()));
+    core::File peer_wait_end(doorbell_fds[0]);
+    core::File peer_ring_end(doorbell_fds[1]);
+
+    // The mapping keeps the memory alive once the file has been closed.
+    core::File memory_file(TRY(system::syscall<uint32_t>(UB_SYS_create_shared_memory, k_memory_size)));
+    auto *memory = TRY(memory_file.mmap<uint8_t>(0, 0, UB_MEMORY_PROT_WRITE, UB_MMAP_FLAG_SHARED));
+    Channel channel(ustd::move(wait_end), ustd::move(peer_ring_end), memory, true);
+
+    // Our ends of the peer's doorbell and vice versa get closed on return, so that each end is only held by one side.
+    TRY(system::syscall(UB_SYS_send_fd, socket_fd, memory_file.fd()));
+    TRY(system::syscall(UB_SYS_send_fd, socket_fd, peer_wait_end.fd()));
+    TRY(system::syscall(UB_SYS_send_fd, socket_fd, ring_end.fd()));
+
+    // Let the peer know that everything has been sent.
+    const uint8_t handshake = 0;
+    TRY(system::syscall(UB_SYS_write, socket_fd, &handshake, 1));
+    return channel;
+}
+
+// Accepts the channel set up by the peer with create, blocking until the peer has sent it.
+ustd::Result<Channel, ub_error_t> Channel::accept(uint32_t socket_fd) {
+    uint8_t handshake = 0;
+    if (TRY(system::syscall(UB_SYS_read, socket_fd, &handshake, 1)) == 0) {
+        return UB_ERROR_BROKEN_HANDLE;
+    }
+    auto memory_file = TRY(receive_fd(socket_fd));
+    auto doorbell = TRY(receive_fd(socket_fd));
+    auto peer_doorbell = TRY(receive_fd(socket_fd));
+    auto *memory = TRY(memory_file.mmap<uint8_t>(0, 0, UB_MEMORY_PROT_WRITE, UB_MMAP_FLAG_SHARED));
+    return Channel(ustd::move(doorbell), ustd::move(peer_doorbell), memory, false);
+}
+
+Channel::Channel(core::File &&doorbell, core::File &&peer_doorbell, uint8_t *memory, bool creator)
+    : m_doorbell(ustd::move(doorbell)), m_peer_doorbell(ustd::move(peer_doorbell)), m_memory(memory) {
+    auto *rings = reinterpret_cast<ChannelRing *>(memory);
+    if (creator) {
+        new (&rings[0]) ChannelRing;
+        new (&rings[1]) ChannelRing;
+    }
+
+    // The creator sends on the first ring and receives on the second, and the accepting side the other way around.
+    m_send_ring = &rings[creator ? 0 : 1];
+    m_receive_ring = &rings[creator ? 1 : 0];
+}
+
+Channel::Channel(Channel &&other)
+    : m_doorbell(ustd::move(other.m_doorbell)), m_peer_doorbell(ustd::move(other.m_peer_doorbell)),
+      m_memory(ustd::exchange(other.m_memory, nullptr)), m_send_ring(ustd::exchange(other.m_send_ring, nullptr)),
+      m_receive_ring(ustd::exchange(other.m_receive_ring, nullptr)), m_event_loop(other.m_event_loop),
+      m_broken(other.m_broken) {}
+
+Channel::~Channel() {
+    if (m_memory == nullptr) {
+        return;
+    }
+    if (m_event_loop != nullptr) {
+        m_event_loop->cancel_ring(m_peer_doorbell.fd());
+    }
+    static_cast<void>(system::syscall(UB_SYS_free_region, m_memory, k_memory_size));
+}
+
+bool Channel::ring_peer() {
+    const uint64_t value = 1;
+    return !m_peer_doorbell.write(value).is_error();
+}
+
+// Copies the next message into the given buffer and returns its size, or returns nothing if the ring is empty or the
+// channel is broken.
+ustd::Optional<size_t> Channel::receive(ustd::Span<uint8_t> buffer) {
+    if (m_broken) {
+        return {};
+    }
+    auto &ring = *m_receive_ring;
+    const uint32_t head = ring.head.load(ustd::memory_order_relaxed);
+
+    // Pairs with the fence in send. The head stored by the previous receive must be visible before we conclude that
+    // the ring is empty and go on to wait, otherwise the sender could miss that it needs to ring our doorbell.
+    ustd::atomic_thread_fence(ustd::memory_order_seq_cst);
+    const uint32_t tail = ring.tail.load(ustd::memory_order_acquire);
+    if (tail == head) {
+        return {};
+    }
+
+    // The peer can write anything into the ring, so a tail or size which doesn't fit means the channel is broken rather
+    // than that we should trust it.
+    if (tail - head > k_ring_capacity || tail - head < sizeof(uint32_t)) {
+        m_broken = true;
+        return {};
+    }
+    uint32_t size = 0;
+    ring.copy_out(head, &size, sizeof(uint32_t));
+    if (size > buffer.size() || size > tail - head - sizeof(uint32_t)) {
+        m_broken = true;
+        return {};
+    }
+    ring.copy_out(head + sizeof(uint32_t), buffer.data(), size);
+    ring.head.store(head + sizeof(uint32_t) + size, ustd::memory_order_release);
+
+    // Pairs with the fence in push, so that either we see that the sender is waiting for room, or it sees our head.
+    ustd::atomic_thread_fence(ustd::memory_order_seq_cst);
+    if (ring.sender_waiting.load(ustd::memory_order_relaxed) != 0) {
+        core::futex_wake(ring.head, 1);
+    }
+    return size;
+}
+
+// Copies the message into the send ring, and returns whether the peer needs ringing for it, or nothing if the peer has
+// gone away.
+ustd::Optional<bool> Channel::push(ustd::Span<const uint8_t> message) {
+    // A message which could never fit would otherwise wait for room forever.
+    ENSURE(message.size() <= k_ring_capacity - sizeof(uint32_t));
+    const auto size = static_cast<uint32_t>(message.size());
+    const auto total_size = static_cast<uint32_t>(sizeof(uint32_t)) + size;
+
+    // Wait for the peer to make room if needed, sleeping on the head until the peer moves it. The peer is rung first,
+    // since a ring may still be waiting on an event loop, which also tells us whether the peer has gone away. The wait
+    // is bounded only so that a peer going away without draining the ring is noticed.
+    auto &ring = *m_send_ring;
+    const uint32_t tail = ring.tail.load(ustd::memory_order_relaxed);
+    while (true) {
+        const uint32_t head = ring.head.load(ustd::memory_order_acquire);
+        if (tail - head <= k_ring_capacity - total_size) {
+            break;
+        }
+        if (!ring_peer()) {
+            return {};
+        }
+        ring.sender_waiting.store(1, ustd::memory_order_relaxed);
+        ustd::atomic_thread_fence(ustd::memory_order_seq_cst);
+        if (ring.head.load(ustd::memory_order_relaxed) == head) {
+            static_cast<void>(core::futex_wait(ring.head, head, k_room_wait_timeout));
+        }
+        ring.sender_waiting.store(0, ustd::memory_order_relaxed);
+    }
+    ring.copy_in(tail, &size, sizeof(uint32_t));
+    ring.copy_in(tail + sizeof(uint32_t), message.data(), size);
+    ring.tail.store(tail + total_size, ustd::memory_order_release);
+
+    // Only ring the peer if the ring was empty before, since otherwise it is still draining the ring or already has a
+    // ring pending. Pairs with the fence in receive, so that either we see the peer's final head, or it sees our tail.
+    ustd::atomic_thread_fence(ustd::memory_order_seq_cst);
+    return ring.head.load(ustd::memory_order_acquire) == tail;
+}
+
+// Sends the request and blocks until the peer rings back, returning false if the peer has gone away. Ringing and
+// waiting happen in a single syscall, which also hands the CPU straight to the peer.
+bool Channel::call(ustd::Span<const uint8_t> request) {
+    auto needs_ring = push(request);
+    if (!needs_ring) {
+        return false;
+    }
+    if (!*needs_ring) {
+        return wait();
+    }
+    auto bytes_read = system::syscall(UB_SYS_call, m_peer_doorbell.fd(), m_doorbell.fd());
+    return !bytes_read.is_error() && bytes_read.value() != 0;
+}
+
+// Returns false if the peer has gone away. With an event loop set, the peer gets rung along with the loop's next poll.
+bool Channel::send(ustd::Span<const uint8_t> message) {
+    auto needs_ring = push(message);
+    if (!needs_ring) {
+        return false;
+    }
+    if (*needs_ring && m_event_loop != nullptr) {
+        m_event_loop->ring_on_poll(m_peer_doorbell.fd());
+        return true;
+    }
+    return !*needs_ring || ring_peer();
+}
+
+// Blocks until the peer rings our doorbell, returning false if the peer has gone away. After returning true, every
+// message sent before the ring can be received.
+bool Channel::wait() {
+    uint64_t count = 0;
+    auto bytes_read = m_doorbell.read({&count, sizeof(count)});
+    return !bytes_read.is_error() && bytes_read.value() != 0;
+}
+
+} // namespace ipc
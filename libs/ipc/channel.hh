@@ -0,0 +1,59 @@
+#pragma once
+
+#include <core/file.hh>
+#include <system/error.h>
+#include <ustd/optional.hh>
+#include <ustd/result.hh>
+#include <ustd/span.hh> // IWYU pragma: keep
+#include <ustd/types.hh>
+
+namespace core {
+
+class EventLoop;
+
+} // namespace core
+
+namespace ipc {
+
+struct ChannelRing;
+
+// A message channel made of memory shared between a client and a server, holding a lock-free ring of messages in each
+// direction. Each side waits on its own doorbell, which the other side only rings when it makes the ring go from empty
+// to non-empty, so messages can be sent and received without any syscalls whilst the peer is still busy with earlier
+// ones. The channel is set up over an already connected socket, which is afterwards only used for sending pages.
+class Channel {
+    core::File m_doorbell;
+    core::File m_peer_doorbell;
+    uint8_t *m_memory;
+    ChannelRing *m_send_ring;
+    ChannelRing *m_receive_ring;
+    core::EventLoop *m_event_loop{nullptr};
+    bool m_broken{false};
+
+    Channel(core::File &&doorbell, core::File &&peer_doorbell, uint8_t *memory, bool creator);
+
+    ustd::Optional<bool> push(ustd::Span<const uint8_t> message);
+    bool ring_peer();
+
+public:
+    static ustd::Result<Channel, ub_error_t> accept(uint32_t socket_fd);
+    static ustd::Result<Channel, ub_error_t> create(uint32_t socket_fd);
+
+    Channel(const Channel &) = delete;
+    Channel(Channel &&other);
+    ~Channel();
+
+    Channel &operator=(const Channel &) = delete;
+    Channel &operator=(Channel &&) = delete;
+
+    bool call(ustd::Span<const uint8_t> request);
+    ustd::Optional<size_t> receive(ustd::Span<uint8_t> buffer);
+    bool send(ustd::Span<const uint8_t> message);
+    bool wait();
+
+    void set_event_loop(core::EventLoop &event_loop) { m_event_loop = &event_loop; }
+    bool broken() const { return m_broken; }
+    uint32_t doorbell_fd() const { return m_doorbell.fd(); }
+};
+
+} // namespace ipc
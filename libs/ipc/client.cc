@@ -2,6 +2,7 @@
 
 #include <core/error.hh>
 #include <core/time.hh>
+#include <ipc/channel.hh>
 #include <ipc/message.hh>
 #include <ipc/message_decoder.hh>
 #include <ipc/message_encoder.hh>
@@ -32,6 +33,24 @@ Client::Client(ustd::Optional<uint32_t> fd) : m_fd(ustd::move(fd)) {
     set_on_read_ready([this] {
         // NOLINTNEXTLINE
         ustd::Array<uint8_t, 8_KiB> buffer;
+        if (m_channel) {
+            // Drain the ring completely, since the peer won't ring again until it has seen it empty.
+            if (!m_channel->wait()) {
+                m_on_disconnect();
+                return;
+            }
+            while (auto size = m_channel->receive(buffer.span())) {
+                MessageDecoder decoder({buffer.data(), *size});
+                if (!m_on_message(decoder)) {
+                    m_on_disconnect();
+                    return;
+                }
+            }
+            if (m_channel->broken()) {
+                m_on_disconnect();
+            }
+            return;
+        }
         size_t bytes_read = wait_message(buffer.span());
         if (bytes_read == 0) {
             m_on_disconnect();
@@ -57,6 +76,23 @@ Client::~Client() {
     }
 }
 
+// Sends the message and waits for the reply to it, which is the same as send_message followed by wait_message, but
+// takes a single syscall over a channel, which also switches straight to the server.
+size_t Client::call(const Message &message, ustd::Span<uint8_t> reply_buffer) {
+    if (!m_channel) {
+        send_message(message);
+        return wait_message(reply_buffer);
+    }
+    // NOLINTNEXTLINE
+    ustd::Array<uint8_t, 8_KiB> buffer;
+    MessageEncoder encoder(buffer.span());
+    message.encode(encoder);
+    if (!m_channel->call({buffer.data(), encoder.size()})) {
+        return 0;
+    }
+    return wait_message(reply_buffer);
+}
+
 bool Client::connect(ustd::StringView path) {
     // TODO: Retries are only a temporary fix. system-server should have proper dependencies/socket takeover.
     for (size_t tries = 100; tries != 0; tries--) {
@@ -66,7 +102,14 @@ bool Client::connect(ustd::StringView path) {
             continue;
         }
         if (!result.is_error()) {
+            auto channel = Channel::accept(static_cast<uint32_t>(result.value()));
+            if (channel.is_error()) {
+                EXPECT(system::syscall(UB_SYS_close, result.value()));
+                log::error("Could not set up channel to {}: {}", path, core::error_string(channel.error()));
+                return false;
+            }
             m_fd.emplace(static_cast<uint32_t>(result.value()));
+            m_channel.emplace(channel.disown_value());
             return true;
         }
         log::error("Could not connect to {}: {}", path, core::error_string(result.error()));
@@ -76,17 +119,56 @@ bool Client::connect(ustd::StringView path) {
     return false;
 }
 
+// Switches a freshly accepted connection over to a shared memory channel, which the client accepts in connect. Must be
+// called before the client is watched by the given event loop, since it changes the descriptor to wait on. Messages
+// to the client ring it along with the event loop's next poll.
+ustd::Result<void, ub_error_t> Client::create_channel(core::EventLoop &event_loop) {
+    m_channel.emplace(TRY(Channel::create(*m_fd)));
+    m_channel->set_event_loop(event_loop);
+    return {};
+}
+
+// Maps the next pages sent by the peer with send_pages. The pages should be freed with UB_SYS_free_region when done.
+ustd::Result<ustd::Span<uint8_t>, ub_error_t> Client::receive_pages() {
+    size_t size = 0;
+    auto *pages = TRY(system::syscall<uint8_t *>(UB_SYS_receive_pages, *m_fd, &size));
+    return ustd::Span<uint8_t>(pages, size);
+}
+
 void Client::send_message(const Message &message) {
     // NOLINTNEXTLINE
     ustd::Array<uint8_t, 8_KiB> buffer;
     MessageEncoder encoder(buffer.span());
     message.encode(encoder);
+    if (m_channel) {
+        [[maybe_unused]] bool sent = m_channel->send({buffer.data(), encoder.size()});
+        ASSERT(sent);
+        return;
+    }
     [[maybe_unused]] auto bytes_written = system::syscall(UB_SYS_write, *m_fd, buffer.data(), encoder.size());
     ASSERT(!bytes_written.is_error());
     ASSERT(bytes_written.value() == encoder.size());
 }
 
+// Moves the given page-aligned memory to the peer without copying it, leaving it unmapped in this process. The pages
+// must come from a single region, such as one from UB_SYS_allocate_region. They should be sent before the message
+// which tells the peer to receive them, so that the peer never finds the queue empty.
+ustd::Result<void, ub_error_t> Client::send_pages(ustd::Span<uint8_t> pages) {
+    TRY(system::syscall(UB_SYS_send_pages, *m_fd, pages.data(), pages.size()));
+    return {};
+}
+
 size_t Client::wait_message(ustd::Span<uint8_t> buffer) {
+    if (m_channel) {
+        while (true) {
+            if (auto size = m_channel->receive(buffer)) {
+                return *size;
+            }
+            if (m_channel->broken() || !m_channel->wait()) {
+                return 0;
+            }
+        }
+    }
     auto bytes_read = system::syscall(UB_SYS_read, *m_fd, buffer.data(), buffer.size());
     ASSERT(!bytes_read.is_error());
     return bytes_read.value();
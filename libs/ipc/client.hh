@@ -1,14 +1,23 @@
 #pragma once
 
 #include <core/watchable.hh>
+#include <ipc/channel.hh>
+#include <system/error.h>
 #include <ustd/array.hh>
 #include <ustd/function.hh>
 #include <ustd/optional.hh>
+#include <ustd/result.hh>
 #include <ustd/span.hh> // IWYU pragma: keep
 #include <ustd/string_view.hh>
 #include <ustd/types.hh>
 #include <ustd/utility.hh>
 
+namespace core {
+
+class EventLoop;
+
+} // namespace core
+
 namespace ipc {
 
 class Message;
@@ -16,6 +25,7 @@ class MessageDecoder;
 
 class Client : public core::Watchable {
     ustd::Optional<uint32_t> m_fd;
+    ustd::Optional<Channel> m_channel;
     ustd::Function<void()> m_on_disconnect{};
     ustd::Function<bool(MessageDecoder &)> m_on_message{};
 
@@ -23,17 +33,23 @@ public:
     explicit Client(ustd::Optional<uint32_t> fd = {});
     Client(const Client &) = delete;
     Client(Client &&other)
-        : m_fd(ustd::move(other.m_fd)), m_on_disconnect(ustd::move(other.m_on_disconnect)),
-          m_on_message(ustd::move(other.m_on_message)) {}
+        : m_fd(ustd::move(other.m_fd)), m_channel(ustd::move(other.m_channel)),
+          m_on_disconnect(ustd::move(other.m_on_disconnect)), m_on_message(ustd::move(other.m_on_message)) {}
     ~Client() override;
 
     Client &operator=(const Client &) = delete;
     Client &operator=(Client &&) = delete;
 
+    size_t call(const Message &message, ustd::Span<uint8_t> reply_buffer);
     bool connect(ustd::StringView path);
+    ustd::Result<void, ub_error_t> create_channel(core::EventLoop &event_loop);
+    ustd::Result<ustd::Span<uint8_t>, ub_error_t> receive_pages();
     void send_message(const Message &message);
+    ustd::Result<void, ub_error_t> send_pages(ustd::Span<uint8_t> pages);
     size_t wait_message(ustd::Span<uint8_t> buffer);
 
+    template <typename R, typename T, typename... Args>
+    R call(Args &&...args);
     template <typename T, typename... Args>
     void send_message(Args &&...args);
     template <typename T>
@@ -43,9 +59,17 @@ public:
     void set_on_message(ustd::Function<bool(MessageDecoder &)> on_message) { m_on_message = ustd::move(on_message); }
 
     bool connected() const { return m_fd.has_value(); }
-    uint32_t fd() const override { return *m_fd; }
+    uint32_t fd() const override { return m_channel ? m_channel->doorbell_fd() : *m_fd; }
 };
 
+template <typename R, typename T, typename... Args>
+R Client::call(Args &&...args) {
+    // NOLINTNEXTLINE
+    ustd::Array<uint8_t, 8_KiB> buffer;
+    size_t bytes_read = call(T(ustd::forward<Args>(args)...), buffer.span());
+    return R::decode({buffer.data(), bytes_read});
+}
+
 template <typename T, typename... Args>
 void Client::send_message(Args &&...args) {
     send_message(T(ustd::forward<Args>(args)...));
@@ -51,6 +51,11 @@ Server<ClientType>::Server(core::EventLoop &event_loop, ustd::StringView path) :
     set_on_read_ready([this] {
         uint32_t client_fd = EXPECT(system::syscall<uint32_t>(UB_SYS_accept, *m_fd));
         auto *client = m_clients.emplace(new ClientType(client_fd)).ptr();
+        if (client->create_channel(m_event_loop).is_error()) {
+            // The client has most likely gone away already.
+            m_clients.remove(m_clients.size() - 1);
+            return;
+        }
         m_event_loop.watch(*client, UB_POLL_EVENT_READ);
         client->set_on_disconnect([this, client] {
             disconnect(client);
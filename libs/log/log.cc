@@ -3,6 +3,7 @@
 #include <ipc/client.hh>
 #include <log/ipc_messages.hh>
 #include <system/syscall.hh>
+#include <ustd/array.hh>
 #include <ustd/assert.hh>
 #include <ustd/string_view.hh>
 
@@ -29,9 +30,12 @@ void message(Level level, ustd::StringView message) {
         s_client->send_message<LogMessage>(level, message);
         return;
     }
-    const char newline = '\n';
-    static_cast<void>(system::syscall(UB_SYS_write, 1, message.data(), message.length()));
-    static_cast<void>(system::syscall(UB_SYS_write, 1, &newline, 1));
+    char newline = '\n';
+    ustd::Array<ub_iovec_t, 2> iovecs{
+        ub_iovec_t{const_cast<char *>(message.data()), message.length()},
+        ub_iovec_t{&newline, 1},
+    };
+    static_cast<void>(system::syscall(UB_SYS_writev, 1, iovecs.data(), iovecs.size()));
 }
 
 } // namespace log
@@ -5,6 +5,7 @@
 #include <ipc/message_decoder.hh>
 #include <ipc/server.hh>
 #include <log/log.hh>
+#include <system/syscall.hh>
 #include <ustd/optional.hh>
 #include <ustd/span.hh>
 #include <ustd/string.hh>
@@ -44,8 +45,12 @@ Domain::Domain(ustd::StringView name) : m_name(name) {
     log::debug("Reading config for {} ({})", name, config_path);
     m_config_file = EXPECT(core::File::open(config_path));
 
-    ustd::LargeVector<char> config_source(EXPECT(m_config_file.size()));
-    EXPECT(m_config_file.read(config_source.span()));
+    // Parse the config in place rather than reading it into a buffer.
+    const size_t config_size = EXPECT(m_config_file.size());
+    ustd::Span<const char> config_source;
+    if (config_size != 0) {
+        config_source = {EXPECT(m_config_file.mmap<const char>(0, config_size)), config_size};
+    }
 
     ustd::Vector<ustd::StringView> lines;
     for (auto *line = &lines.emplace(config_source.data(), 0u); const auto &ch : config_source) {
@@ -71,6 +76,11 @@ Domain::Domain(ustd::StringView name) : m_name(name) {
         ustd::String value(line.substr(equal_index + 1));
         m_key_values.emplace(KeyValue{ustd::move(key), ustd::move(value)});
     }
+
+    // The keys and values have been copied out, so the mapping is no longer needed.
+    if (!config_source.empty()) {
+        EXPECT(system::syscall(UB_SYS_free_region, config_source.data(), config_source.size()));
+    }
 }
 
 ustd::Optional<ustd::StringView> Domain::lookup(ustd::StringView key) const {
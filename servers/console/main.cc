@@ -6,6 +6,7 @@
 #include <console/ipc_messages.hh>
 #include <core/event_loop.hh>
 #include <core/file.hh>
+#include <core/process.hh>
 #include <core/timer.hh>
 #include <ipc/client.hh>
 #include <ipc/message_decoder.hh>
@@ -23,6 +24,7 @@
 
 size_t main(size_t, const char **) {
     log::initialise("console-server");
+    EXPECT(core::set_priority(core::pid(), UB_PRIORITY_INTERACTIVE));
     core::EventLoop event_loop;
     core::File stdin(static_cast<uint32_t>(0));
     event_loop.watch(stdin, UB_POLL_EVENT_READ);
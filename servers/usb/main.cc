@@ -6,6 +6,7 @@
 #include <core/error.hh>
 #include <core/event_loop.hh>
 #include <core/file.hh>
+#include <core/process.hh>
 #include <log/log.hh>
 #include <ustd/optional.hh>
 #include <ustd/result.hh>
@@ -35,6 +36,7 @@ ustd::Vector<HostController> find_host_controllers(core::EventLoop &event_loop)
 
 size_t main(size_t, const char **) {
     log::initialise("usb-server");
+    EXPECT(core::set_priority(core::pid(), UB_PRIORITY_INTERACTIVE));
     core::EventLoop event_loop;
     config::listen(event_loop);
     config::read("usb-server");
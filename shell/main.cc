@@ -71,6 +71,7 @@ void Job::spawn(const ustd::Vector<ub_fd_pair_t> &copy_fds) {
 }
 
 size_t main(size_t, const char **) {
+    EXPECT(core::set_priority(core::pid(), UB_PRIORITY_INTERACTIVE));
     LineEditor editor("# "sv);
     while (true) {
         editor.begin_line();
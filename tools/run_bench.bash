@@ -0,0 +1,46 @@
+#!/bin/bash
+set -eu
+
+# Boots the given sysroot headless and waits for the bench suite to finish, printing its results as lines of
+# space-separated key=value pairs. Results are also written to the optional third argument.
+timeout=${BENCH_TIMEOUT:-600}
+log=$(mktemp)
+trap 'rm -f $log' EXIT
+
+flags+=("-bios $1")
+flags+=("-debugcon file:$log")
+flags+=("-device qemu-xhci")
+flags+=("-device usb-storage,drive=esp")
+flags+=("-device virtio-vga")
+flags+=("-display none")
+flags+=("-drive file=fat:rw:$2,format=raw,id=esp,if=none")
+flags+=("-machine q35")
+flags+=("-nodefaults")
+flags+=("-no-reboot")
+flags+=("-smp 6")
+
+if [[ -e /dev/kvm ]]; then
+    flags+=("-cpu host")
+    flags+=("-enable-kvm")
+else
+    flags+=("-cpu max")
+fi
+
+qemu-system-x86_64 ${flags[@]} &
+qemu_pid=$!
+
+# There's no way to power off from inside yet, so wait for the final line and then kill QEMU.
+for ((i = 0; i < timeout; i++)); do
+    if grep -q 'bench done' $log || ! kill -0 $qemu_pid 2> /dev/null; then
+        break
+    fi
+    sleep 1
+done
+kill $qemu_pid 2> /dev/null || true
+wait $qemu_pid 2> /dev/null || true
+
+if ! grep -q 'bench done' $log; then
+    echo "bench: no results after ${timeout}s; is the kernel built with -e kernel_qemu_debug?" >&2
+    exit 1
+fi
+grep -o 'bench name=.*' $log | tee ${3:-/dev/null}
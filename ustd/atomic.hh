@@ -57,12 +57,19 @@ public:
 
 template <SimpleAtomic T, int Order>
 bool Atomic<T, Order>::cmpxchg(T expected, T desired, int success_order, int failure_order) volatile {
-    return __atomic_compare_exchange_n(&m_value, &expected, storage_t(desired), false, success_order, failure_order);
+    auto raw_expected = storage_t(expected);
+    return __atomic_compare_exchange_n(&m_value, &raw_expected, storage_t(desired), false, success_order,
+                                       failure_order);
 }
 
 template <SimpleAtomic T, int Order>
 bool Atomic<T, Order>::compare_exchange(T &expected, T desired, int success_order, int failure_order) volatile {
-    return __atomic_compare_exchange_n(&m_value, &expected, storage_t(desired), false, success_order, failure_order);
+    // Go through the storage type so that enums work, and copy back the value that was seen on failure.
+    auto raw_expected = storage_t(expected);
+    const bool exchanged = __atomic_compare_exchange_n(&m_value, &raw_expected, storage_t(desired), false,
+                                                       success_order, failure_order);
+    expected = T(raw_expected);
+    return exchanged;
 }
 
 template <SimpleAtomic T, int Order>
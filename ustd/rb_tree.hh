@@ -14,6 +14,11 @@ class TreeNodeBase;
 template <typename D>
 concept TreeNode = is_base_of<TreeNodeBase<D>, D>;
 
+// A node which caches information about its subtree. update_subtree is called whenever the node's children change, and
+// should recompute the cached information from the node itself and its children.
+template <typename D>
+concept AugmentedTreeNode = requires(D &node) { node.update_subtree(); };
+
 template <typename D>
 class TreeNodeBase {
     template <Integral K, TreeNode N, typename N::template key_fn_t<K> get_key>
@@ -36,6 +41,10 @@ private:
 public:
     template <Integral K>
     using key_fn_t = K (D::*)() const;
+
+    D *parent_node() const { return parent; }
+    D *left_node() const { return left_child; }
+    D *right_node() const { return right_child; }
 };
 
 template <Integral K, TreeNode N, typename N::template key_fn_t<K> get_key>
@@ -49,11 +58,21 @@ private:
     N *m_root_node{nullptr};
     N *m_minimum_node{nullptr};
 
+    static bool is_black(N *node) { return node == nullptr || node->colour == N::Black; }
+    static void update(N *node);
+    static void update_path(N *node);
+
     template <Direction Dir>
     void rotate(N *node);
+    void rotate(N *node, Direction dir) { dir == L ? rotate<L>(node) : rotate<R>(node); }
     void insert_fixups(N *node);
+    void remove_fixups(N *node, N *parent);
+    void transplant(N *node, N *replacement);
 
 public:
+    static N *successor(N *node);
+    N *find(K key) const;
+    N *find_floor(K key) const;
     void insert(N *node);
     void remove(N *node);
 
@@ -61,6 +80,22 @@ public:
     N *minimum_node() const { return m_minimum_node; }
 };
 
+template <Integral K, TreeNode N, typename N::template key_fn_t<K> get_key>
+void RedBlackTree<K, N, get_key>::update(N *node) {
+    if constexpr (AugmentedTreeNode<N>) {
+        node->update_subtree();
+    }
+}
+
+template <Integral K, TreeNode N, typename N::template key_fn_t<K> get_key>
+void RedBlackTree<K, N, get_key>::update_path(N *node) {
+    if constexpr (AugmentedTreeNode<N>) {
+        for (; node != nullptr; node = node->parent) {
+            node->update_subtree();
+        }
+    }
+}
+
 template <Integral K, TreeNode N, typename N::template key_fn_t<K> get_key>
 template <typename RedBlackTree<K, N, get_key>::Direction Dir>
 void RedBlackTree<K, N, get_key>::rotate(N *node) {
@@ -85,6 +120,10 @@ void RedBlackTree<K, N, get_key>::rotate(N *node) {
     } else {
         parent->right_child = pivot;
     }
+
+    // The pivot now covers the same set of nodes that node used to, so nothing above it needs updating.
+    update(node);
+    update(pivot);
 }
 
 template <Integral K, TreeNode N, typename N::template key_fn_t<K> get_key>
@@ -99,20 +138,115 @@ void RedBlackTree<K, N, get_key>::insert_fixups(N *node) {
             grand_parent->colour = N::Red;
             node = grand_parent;
         } else {
-            if (node->parent->children[1 - dir] == node) {
+            if (node->parent->children[dir] == node) {
                 node = node->parent;
-                dir == L ? rotate<R>(node) : rotate<L>(node);
+                rotate(node, dir == L ? R : L);
             }
             node->parent->colour = N::Black;
             grand_parent->colour = N::Red;
-            dir == L ? rotate<L>(grand_parent) : rotate<R>(grand_parent);
+            rotate(grand_parent, dir);
         }
     }
     m_root_node->colour = N::Black;
 }
 
+template <Integral K, TreeNode N, typename N::template key_fn_t<K> get_key>
+void RedBlackTree<K, N, get_key>::remove_fixups(N *node, N *parent) {
+    // Note that node may be null, in which case parent is the parent it would have had.
+    while (node != m_root_node && is_black(node)) {
+        const auto dir = parent->left_child == node ? L : R;
+        auto *sibling = parent->children[1 - dir];
+        if (sibling->colour == N::Red) {
+            sibling->colour = N::Black;
+            parent->colour = N::Red;
+            rotate(parent, dir);
+            sibling = parent->children[1 - dir];
+        }
+        if (is_black(sibling->left_child) && is_black(sibling->right_child)) {
+            sibling->colour = N::Red;
+            node = parent;
+            parent = node->parent;
+            continue;
+        }
+        if (is_black(sibling->children[1 - dir])) {
+            sibling->children[dir]->colour = N::Black;
+            sibling->colour = N::Red;
+            rotate(sibling, dir == L ? R : L);
+            sibling = parent->children[1 - dir];
+        }
+        sibling->colour = parent->colour;
+        parent->colour = N::Black;
+        sibling->children[1 - dir]->colour = N::Black;
+        rotate(parent, dir);
+        node = m_root_node;
+    }
+    if (node != nullptr) {
+        node->colour = N::Black;
+    }
+}
+
+template <Integral K, TreeNode N, typename N::template key_fn_t<K> get_key>
+void RedBlackTree<K, N, get_key>::transplant(N *node, N *replacement) {
+    if (node->parent == nullptr) {
+        m_root_node = replacement;
+    } else if (node->parent->left_child == node) {
+        node->parent->left_child = replacement;
+    } else {
+        node->parent->right_child = replacement;
+    }
+    if (replacement != nullptr) {
+        replacement->parent = node->parent;
+    }
+}
+
+template <Integral K, TreeNode N, typename N::template key_fn_t<K> get_key>
+N *RedBlackTree<K, N, get_key>::successor(N *node) {
+    if (node->right_child != nullptr) {
+        node = node->right_child;
+        while (node->left_child != nullptr) {
+            node = node->left_child;
+        }
+        return node;
+    }
+    auto *temp = node->parent;
+    while (temp != nullptr && node == temp->right_child) {
+        node = temp;
+        temp = temp->parent;
+    }
+    return temp;
+}
+
+template <Integral K, TreeNode N, typename N::template key_fn_t<K> get_key>
+N *RedBlackTree<K, N, get_key>::find(K key) const {
+    auto *node = m_root_node;
+    while (node != nullptr && (node->*get_key)() != key) {
+        node = node->children[key < (node->*get_key)() ? L : R];
+    }
+    return node;
+}
+
+// Returns the node with the largest key less than or equal to the given key, or null if there isn't one.
+template <Integral K, TreeNode N, typename N::template key_fn_t<K> get_key>
+N *RedBlackTree<K, N, get_key>::find_floor(K key) const {
+    N *floor = nullptr;
+    for (auto *node = m_root_node; node != nullptr;) {
+        if (key < (node->*get_key)()) {
+            node = node->left_child;
+        } else {
+            floor = node;
+            node = node->right_child;
+        }
+    }
+    return floor;
+}
+
 template <Integral K, TreeNode N, typename N::template key_fn_t<K> get_key>
 void RedBlackTree<K, N, get_key>::insert(N *node) {
+    node->parent = nullptr;
+    node->left_child = nullptr;
+    node->right_child = nullptr;
+    node->colour = N::Red;
+
     N *parent = m_root_node;
     for (auto *temp = parent; temp != nullptr;) {
         if ((node->*get_key)() < (temp->*get_key)()) {
@@ -130,6 +264,7 @@ void RedBlackTree<K, N, get_key>::insert(N *node) {
         node->colour = N::Black;
         m_root_node = node;
         m_minimum_node = node;
+        update(node);
         return;
     }
 
@@ -141,29 +276,58 @@ void RedBlackTree<K, N, get_key>::insert(N *node) {
         ASSERT(parent->right_child == nullptr);
         parent->right_child = node;
     }
-
-    if (node->parent->parent != nullptr) {
-        insert_fixups(node);
-    }
-
-    if (m_minimum_node->left_child == node) {
+    if ((node->*get_key)() < (m_minimum_node->*get_key)()) {
         m_minimum_node = node;
     }
+
+    update_path(node);
+    insert_fixups(node);
 }
 
 template <Integral K, TreeNode N, typename N::template key_fn_t<K> get_key>
-void RedBlackTree<K, N, get_key>::remove(N *node) {}
+void RedBlackTree<K, N, get_key>::remove(N *node) {
+    if (m_minimum_node == node) {
+        m_minimum_node = successor(node);
+    }
 
-class FooNode : public TreeNodeBase<FooNode> {
-public:
-    int key() const;
-};
+    // Splice out node, or its successor if it has two children, keeping track of the node that moves into the spliced
+    // out node's position and its parent, which is where any rebalancing starts.
+    auto removed_colour = node->colour;
+    N *child;
+    N *child_parent;
+    if (node->left_child == nullptr || node->right_child == nullptr) {
+        child = node->left_child != nullptr ? node->left_child : node->right_child;
+        child_parent = node->parent;
+        transplant(node, child);
+    } else {
+        auto *next = node->right_child;
+        while (next->left_child != nullptr) {
+            next = next->left_child;
+        }
+        removed_colour = next->colour;
+        child = next->right_child;
+        if (next->parent == node) {
+            child_parent = next;
+        } else {
+            child_parent = next->parent;
+            transplant(next, next->right_child);
+            next->right_child = node->right_child;
+            next->right_child->parent = next;
+        }
+        transplant(node, next);
+        next->left_child = node->left_child;
+        next->left_child->parent = next;
+        next->colour = node->colour;
+    }
 
-using FooTree = RedBlackTree<int, FooNode, &FooNode::key>;
+    update_path(child_parent);
+    if (removed_colour == N::Black) {
+        remove_fixups(child, child_parent);
+    }
 
-inline void foo() {
-    FooTree tree;
-    tree.insert(nullptr);
+    node->parent = nullptr;
+    node->left_child = nullptr;
+    node->right_child = nullptr;
 }
 
 } // namespace ustd